@@ -6,8 +6,10 @@ import orion_types::*;
     input logic         clk_i,
     input logic         rst_i,
     input logic         flush_req_i,
+    input logic         timer_irq_i,
     
     output logic        load_use_stall_req_o,
+    output logic        wfi_sleep_o,
 
     input if_id_t       if_id_i,
     input ex_id_t       ex_id_i,
@@ -46,6 +48,7 @@ import orion_types::*;
 
 
     logic exception_illegal_instr;
+    logic is_wfi;
 
     always_comb begin 
         id_ex_o.alu_op          = ALU_OP_ADD;
@@ -63,6 +66,7 @@ import orion_types::*;
         id_ex_o.is_jump_conditional = 1'b0;
 
         exception_illegal_instr = 1'b0;
+        is_wfi = 1'b0;
 
         unique case (opcode) 
             OP_REG : begin
@@ -203,6 +207,10 @@ import orion_types::*;
                 if(imm_i[11:0] == 12'b000000000001 && rs1_s==5'b00000 && funct3==3'b000 && rd_s==5'b00000) begin
                     // EBREAK instruction (NOP)
                 end
+                else if(imm_i[11:0] == 12'b000100000101 && rs1_s==5'b00000 && funct3==3'b000 && rd_s==5'b00000) begin
+                    // WFI instruction (NOP once the timer interrupt is pending)
+                    is_wfi = 1'b1;
+                end
                 else begin
                     exception_illegal_instr = 1'b1;
                 end
@@ -294,7 +302,13 @@ import orion_types::*;
 
     assign load_use_stall_req_o = rs1_load_use_hazard || rs2_load_use_hazard;
 
-    assign id_ex_o.valid = (flush_req_i || load_use_stall_req_o) ? 1'b0 : if_id_i.valid ;
+    // WFI: hold the instruction in decode (bubbles to execute) until the timer
+    // interrupt is pending. No trap is taken, WFI then retires as a NOP.
+    logic wfi_sleep /* verilator public */;
+    assign wfi_sleep = if_id_i.valid && is_wfi && !timer_irq_i && !flush_req_i;
+    assign wfi_sleep_o = wfi_sleep;
+
+    assign id_ex_o.valid = (flush_req_i || load_use_stall_req_o || wfi_sleep) ? 1'b0 : if_id_i.valid ;
     assign id_ex_o.pc    = if_id_i.pc;
     assign id_ex_o.rs1_v = rs1_v_fwd;
     assign id_ex_o.rs2_v = rs2_v_fwd;
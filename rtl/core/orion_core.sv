@@ -26,8 +26,13 @@ import orion_types::*;
     output logic [MASKW-1:0]    dmem_mask_o,
     output logic                dmem_we_o,
     output logic                dmem_valid_o,
-    input  logic                dmem_resp_i
+    input  logic                dmem_resp_i,
     // input  logic                dmem_stall_i
+    output logic                dmem_busy_o,    // Memory stage waits for a response
+
+    // Machine timer interrupt (wakes up WFI)
+    input  logic                timer_irq_i,
+    output logic                sleep_o         /* verilator public */  // Sleeping in WFI, pipeline drained
 );
     // Interfaces
     if_id_t  if_id, if_id_reg;
@@ -54,6 +59,7 @@ import orion_types::*;
     logic mem_wb_stall;
 
     logic load_use_stall_req;
+    logic wfi_sleep;
 
     logic mem_stall_o;
 
@@ -62,7 +68,7 @@ import orion_types::*;
     // Stall logic
     assign if_pc_stall  = if_id_stall /*|| imem_stall_i*/;
 
-    assign if_id_stall  = id_ex_stall || load_use_stall_req;
+    assign if_id_stall  = id_ex_stall || load_use_stall_req || wfi_sleep;
     assign id_ex_stall  = ex_mem_stall /*|| dmem_stall_i*/;
     assign ex_mem_stall = mem_stall_o;
     assign mem_wb_stall = 1'b0;
@@ -109,7 +115,10 @@ import orion_types::*;
         .rst_i          (rst_i),
         .flush_req_i    (id_flush_req),
 
+        .timer_irq_i    (timer_irq_i),
+
         .load_use_stall_req_o (load_use_stall_req),
+        .wfi_sleep_o    (wfi_sleep),
         
         .if_id_i        (if_id_reg),
         .ex_id_i        (ex_id),
@@ -200,6 +209,33 @@ import orion_types::*;
 
 
 
+    ////////////////////////////////////////////////////////////////////////////
+    // Sleep: nothing changes but the timer until it wakes up WFI (the
+    // simulator skips these cycles). The pipeline is drained and the fetch of
+    // the held PC completes this cycle, so no memory response is outstanding
+    assign dmem_busy_o = mem_stall_o;
+    assign sleep_o = wfi_sleep && !id_ex_reg.valid && !ex_mem_reg.valid && !mem_wb_reg.valid && imem_resp_i;
+
+    // PC of the instruction presenting the dmem request (the simulator keys
+    // cycle-polling loops by it)
+    logic [XLEN-1:0] dmem_pc /* verilator public */;
+    assign dmem_pc = id_ex_reg.pc;
+
+`ifndef SYNTHESIS
+    // Store retiring at the next clock edge (leaves the memory stage for
+    // writeback): the simulator passes device stores on here, so that a store
+    // that does not retire has no side effects
+    logic             st_commit         /* verilator public */;
+    logic [ADDRW-1:0] st_commit_addr    /* verilator public */;
+    logic [XLEN-1:0]  st_commit_wdata   /* verilator public */;
+    logic [MASKW-1:0] st_commit_mask    /* verilator public */;
+    assign st_commit       = mem_wb.valid && ex_mem_reg.is_store;
+    assign st_commit_addr  = {ex_mem_reg.debug.mem_addr[ADDRW-1:2], 2'b00};
+    assign st_commit_wdata = ex_mem_reg.debug.mem_wdata;
+    assign st_commit_mask  = ex_mem_reg.debug.mem_wmask;
+`endif
+
+
     // `UNDRIVEN_VAR(dmem_addr_o)
     // `UNDRIVEN_VAR(dmem_wdata_o)
     // `UNDRIVEN_VAR(dmem_mask_o)
@@ -0,0 +1,89 @@
+`include "utils.svh"
+`default_nettype none
+
+/*
+    Description: CLINT-style machine timer. mtime counts clock cycles from
+    reset, the timer interrupt is pending while mtime >= mtimecmp (mtimecmp
+    resets to all ones, so it is never pending until software sets it).
+
+    Registers (offsets, 32-bit accesses):
+        0x4000: mtimecmp low word
+        0x4004: mtimecmp high word
+        0xBFF8: mtime low word
+        0xBFFC: mtime high word
+    Other offsets read as 0 and ignore writes. Responses are valid one cycle
+    after the request, like dpram's.
+*/
+
+module clint #(
+    parameter ADDRW         = 16,   // Offset width
+    parameter DATAW         = 32,
+    parameter MASKW         = DATAW/8
+) (
+    input  logic                clk_i,
+    input  logic                rst_i,
+
+    input  logic [ADDRW-1:0]    addr_i,
+    input  logic [DATAW-1:0]    data_i,
+    output logic [DATAW-1:0]    data_o,
+    input  logic [MASKW-1:0]    mask_i,
+    input  logic                we_i,
+    input  logic                valid_i,
+    output logic                resp_o,
+
+    output logic                timer_irq_o
+);
+    localparam logic [ADDRW-1:0] MTIMECMP_LO = 'h4000;
+    localparam logic [ADDRW-1:0] MTIMECMP_HI = 'h4004;
+    localparam logic [ADDRW-1:0] MTIME_LO    = 'hBFF8;
+    localparam logic [ADDRW-1:0] MTIME_HI    = 'hBFFC;
+
+    // Public so that the simulator can skip the cycles the core sleeps in WFI
+    logic [63:0] mtime      /* verilator public */;
+    logic [63:0] mtimecmp   /* verilator public */;
+
+    // Merge the written bytes into a register word
+    function automatic logic [DATAW-1:0] merge(input logic [DATAW-1:0] old);
+        for (integer i = 0; i < MASKW; i++) begin
+            merge[i*8 +: 8] = mask_i[i] ? data_i[i*8 +: 8] : old[i*8 +: 8];
+        end
+    endfunction
+
+    logic [ADDRW-1:0] offset;
+    assign offset = {addr_i[ADDRW-1:2], 2'b00};
+
+    always_ff @(posedge clk_i) begin
+        if (rst_i) begin
+            mtime    <= 0;
+            mtimecmp <= '1;
+            data_o   <= 0;
+            resp_o   <= 0;
+        end
+        else begin
+            mtime  <= mtime + 1;
+            resp_o <= valid_i;
+            if (valid_i) begin
+                case (offset)
+                    MTIMECMP_LO: data_o <= mtimecmp[31:0];
+                    MTIMECMP_HI: data_o <= mtimecmp[63:32];
+                    MTIME_LO:    data_o <= mtime[31:0];
+                    MTIME_HI:    data_o <= mtime[63:32];
+                    default:     data_o <= 0;
+                endcase
+                if (we_i) begin
+                    case (offset)
+                        MTIMECMP_LO: mtimecmp[31:0]  <= merge(mtimecmp[31:0]);
+                        MTIMECMP_HI: mtimecmp[63:32] <= merge(mtimecmp[63:32]);
+                        MTIME_LO:    mtime[31:0]     <= merge(mtime[31:0]);
+                        MTIME_HI:    mtime[63:32]    <= merge(mtime[63:32]);
+                        default: ;
+                    endcase
+                end
+            end
+        end
+    end
+
+    assign timer_irq_o = mtime >= mtimecmp;
+
+    `UNUSED_VAR(addr_i)
+endmodule
@@ -0,0 +1,137 @@
+`include "utils.svh"
+`default_nettype none
+
+/*
+    Description: Simulation-only drop-in for dpram whose response timing comes
+    from a C++ model (orionsim MemModel) through DPI. The storage stays in the
+    mem array, so it is accessed by the simulator exactly like dpram's, unless
+    MEM_SPARSE is defined: then it is the simulator's sparse guest memory,
+    read and written through DPI, and SIZE can be hundreds of MB.
+
+    Each port holds one request at a time. A request is accepted (read and
+    written) at the clock edge the model allows it, and its response is valid
+    for one cycle once the model's latency has elapsed. Requests presented
+    while a port is busy are ignored; the core re-presents them until it gets
+    a response.
+*/
+
+import "DPI-C" function void dpi_mem_tick(input longint model);
+import "DPI-C" function int  dpi_mem_cycle(input longint model, input int port, input bit valid, input bit we);
+import "DPI-C" function void dpi_mem_reset(input longint model);
+`ifdef MEM_SPARSE
+import "DPI-C" function int  dpi_mem_read(input longint model, input int index);
+import "DPI-C" function void dpi_mem_write(input longint model, input int index, input int data, input byte mask);
+`endif
+
+module dpi_mem #(
+    /* verilator lint_off UNUSEDPARAM */
+    parameter SIZE          = 1024, // Memory size in bytes
+    parameter DATAW         = 32,   // Data width
+    parameter INIT_FILE     = "",   // Memory initialization file (unused with MEM_SPARSE)
+
+    parameter DEPTH         = SIZE/(DATAW/8),
+    parameter ADDRW         = $clog2(SIZE),
+    parameter MASKW         = DATAW/8
+    /* verilator lint_on UNUSEDPARAM */
+) (
+    input  logic                clk_i,
+    input  logic                rst_i,
+
+    // Read only port
+    input  logic [ADDRW-1:0]    p0_addr_i,
+    output logic [DATAW-1:0]    p0_data_o,
+    input  logic                p0_valid_i,
+    output logic                p0_resp_o,
+
+    // Read/Write port
+    input  logic [ADDRW-1:0]    p1_addr_i,
+    input  logic [DATAW-1:0]    p1_data_i,
+    output logic [DATAW-1:0]    p1_data_o,
+    input  logic [MASKW-1:0]    p1_mask_i,
+    input  logic                p1_we_i,
+    input  logic                p1_valid_i,
+    output logic                p1_resp_o
+);
+    // dpi_mem_cycle() result bits
+    localparam MEM_ACCEPT   = 0;    // Access the memory at this edge
+    localparam MEM_RESP     = 1;    // Response valid in the next cycle
+
+    // Port numbers of the model
+    localparam PORT_IMEM    = 0;
+    localparam PORT_DMEM    = 1;
+
+    // Timing model handle (set by the simulator)
+    /* verilator lint_off UNDRIVEN */
+    logic [63:0] model_h /* verilator public_flat_rw */;
+    /* verilator lint_on UNDRIVEN */
+
+    // Calculate memory array index
+    logic [ADDRW-$clog2(DATAW/8)-1:0] p0_r_index;
+    assign p0_r_index = p0_addr_i[ADDRW-1:$clog2(DATAW/8)];
+
+    logic [ADDRW-$clog2(DATAW/8)-1:0] p1_rw_index;
+    assign p1_rw_index = p1_addr_i[ADDRW-1:$clog2(DATAW/8)];
+
+`ifndef MEM_SPARSE
+    // Memory array
+    logic [DATAW-1:0] mem [0:DEPTH-1] /* verilator public */;
+
+    // Optional memory initialization
+    initial begin
+        if (INIT_FILE != "") begin
+            $readmemh(INIT_FILE, mem);
+        end
+    end
+`endif
+
+    // The data port is asked first so that it wins a shared bandwidth limit.
+    // Both ports read before the write, as in dpram.
+    /* verilator lint_off BLKSEQ */
+    always_ff @(posedge clk_i) begin: mem_access
+        int p0_st, p1_st;
+        if (rst_i) begin
+            dpi_mem_reset(model_h);
+            p0_data_o  <= 0;
+            p0_resp_o  <= 0;
+            p1_data_o  <= 0;
+            p1_resp_o  <= 0;
+        end
+        else begin
+            dpi_mem_tick(model_h);
+            p1_st = dpi_mem_cycle(model_h, PORT_DMEM, p1_valid_i, p1_we_i);
+            p0_st = dpi_mem_cycle(model_h, PORT_IMEM, p0_valid_i, 1'b0);
+
+`ifdef MEM_SPARSE
+            if (p0_st[MEM_ACCEPT]) begin
+                p0_data_o <= dpi_mem_read(model_h, int'(p0_r_index));
+            end
+            if (p1_st[MEM_ACCEPT]) begin
+                p1_data_o <= dpi_mem_read(model_h, int'(p1_rw_index));
+                if (p1_we_i) begin
+                    dpi_mem_write(model_h, int'(p1_rw_index), p1_data_i, 8'(p1_mask_i));
+                end
+            end
+`else
+            if (p0_st[MEM_ACCEPT]) begin
+                p0_data_o <= mem[p0_r_index];
+            end
+            if (p1_st[MEM_ACCEPT]) begin
+                p1_data_o <= mem[p1_rw_index];
+                if (p1_we_i) begin
+                    for (integer i = 0; i < MASKW; i++) begin
+                        if (p1_mask_i[i]) begin
+                            mem[p1_rw_index][i*8 +: 8] <= p1_data_i[i*8 +: 8];
+                        end
+                    end
+                end
+            end
+`endif
+            p0_resp_o <= p0_st[MEM_RESP];
+            p1_resp_o <= p1_st[MEM_RESP];
+        end
+    end
+    /* verilator lint_on BLKSEQ */
+
+    `UNUSED_VAR(p0_addr_i)
+    `UNUSED_VAR(p1_addr_i)
+endmodule
@@ -31,14 +31,19 @@ import orion_soc_types::*;
     logic                imem_resp_i;
 //   logic                imem_stall_i;
 
-    logic [ADDRW-1:0]    dmem_addr_o;
+    // Request signals are public: the simulator decodes its devices on them
+    logic [ADDRW-1:0]    dmem_addr_o    /* verilator public */;
     logic [DATAW-1:0]    dmem_rdata_i;
-    logic [DATAW-1:0]    dmem_wdata_o;
-    logic [MASKW-1:0]    dmem_mask_o;
-    logic                dmem_we_o;
-    logic                dmem_valid_o;
+    logic [DATAW-1:0]    dmem_wdata_o   /* verilator public */;
+    logic [MASKW-1:0]    dmem_mask_o    /* verilator public */;
+    logic                dmem_we_o      /* verilator public */;
+    logic                dmem_valid_o   /* verilator public */;
     logic                dmem_resp_i;
 //    logic                dmem_stall_i;
+    logic                dmem_busy;
+
+    logic                timer_irq;
+    logic                core_sleep;
 
     orion_core #(
         .PC_RESET_ADDR (SOC_RESET_ADDR)
@@ -58,8 +63,50 @@ import orion_soc_types::*;
         .dmem_mask_o    (dmem_mask_o),
         .dmem_we_o      (dmem_we_o),
         .dmem_valid_o   (dmem_valid_o),
-        .dmem_resp_i    (dmem_resp_i)
+        .dmem_resp_i    (dmem_resp_i),
 //        .dmem_stall_i   (dmem_stall_i)
+        .dmem_busy_o    (dmem_busy),
+
+        .timer_irq_i    (timer_irq),
+        .sleep_o        (core_sleep)
+    );
+
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Data port decode: CLINT or memory
+    logic clint_sel;
+    assign clint_sel = (dmem_addr_o & ~(SOC_CLINT_SIZE - 1)) == SOC_CLINT_ADDR;
+
+    logic [DATAW-1:0] mem_rdata;
+    logic             mem_resp;
+    logic [DATAW-1:0] clint_rdata;
+    logic             clint_resp;
+
+    // The core presents the next request while it waits for a (DPI memory)
+    // response: the CLINT only takes it once the memory stage moves on
+    logic clint_valid;
+    assign clint_valid = dmem_valid_o && clint_sel && !dmem_busy;
+
+    assign dmem_rdata_i = clint_resp ? clint_rdata : mem_rdata;
+    assign dmem_resp_i  = clint_resp || mem_resp;
+
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Machine timer
+    clint #(
+        .ADDRW      ($clog2(SOC_CLINT_SIZE)),
+        .DATAW      (DATAW)
+    ) clint (
+        .clk_i      (clk_i),
+        .rst_i      (rst_i),
+        .addr_i     (dmem_addr_o[$clog2(SOC_CLINT_SIZE)-1:0]),
+        .data_i     (dmem_wdata_o),
+        .data_o     (clint_rdata),
+        .mask_i     (dmem_mask_o),
+        .we_i       (dmem_we_o),
+        .valid_i    (clint_valid),
+        .resp_o     (clint_resp),
+        .timer_irq_o(timer_irq)
     );
 
 
@@ -115,7 +162,7 @@ import orion_soc_types::*;
         else $error("[%0t] Illegal memory access: valid=%b, addr=0x%0h", $time, imem_valid_o, imem_addr_o);
 
     assert property (@(posedge clk_i) disable iff (rst_i) 
-        dmem_valid_o |-> ((dmem_addr_o >= SOC_MEM_ADDR) && (dmem_addr_o < (SOC_MEM_ADDR + SOC_MEM_SIZE))))
+        dmem_valid_o |-> (clint_sel || ((dmem_addr_o >= SOC_MEM_ADDR) && (dmem_addr_o < (SOC_MEM_ADDR + SOC_MEM_SIZE)))))
         else $error("[%0t] Illegal memory access: valid=%b, addr=0x%0h", $time, dmem_valid_o, dmem_addr_o);
 
     // spram #(
@@ -136,12 +183,21 @@ import orion_soc_types::*;
     // );
 
 
+`ifdef MEM_DPI
+    // Memory timing modelled by the simulator (latency, bandwidth, jitter)
+    dpi_mem # (
+        .SIZE       (SOC_MEM_SIZE),
+        .DATAW      (XLEN),
+        .INIT_FILE  (`MEM_INIT_FILE)
+    ) memory (
+`else
     dpram # (
         .SIZE       (SOC_MEM_SIZE),
         .DATAW      (XLEN),
         .EN_PIPE    (1),
         .INIT_FILE  (`MEM_INIT_FILE)
     ) memory (
+`endif
         .clk_i(clk_i),
         .rst_i(rst_i),
 
@@ -154,14 +210,15 @@ import orion_soc_types::*;
         // Read-Write port
         .p1_addr_i  (dmem_addr_o[$clog2(SOC_MEM_SIZE)-1:0]),
         .p1_data_i  (dmem_wdata_o),
-        .p1_data_o  (dmem_rdata_i),
+        .p1_data_o  (mem_rdata),
         .p1_mask_i  (dmem_mask_o),
         .p1_we_i    (dmem_we_o),
-        .p1_valid_i (dmem_valid_o),
-        .p1_resp_o  (dmem_resp_i)
+        .p1_valid_i (dmem_valid_o && !clint_sel),
+        .p1_resp_o  (mem_resp)
     );
 
     // `UNUSED_VAR(mem_addr_aligned)
     `UNUSED_VAR(imem_addr_o)
     `UNUSED_VAR(dmem_addr_o)
+    `UNUSED_VAR(core_sleep)
 endmodule
@@ -3,7 +3,15 @@ package orion_soc_types;
     // parameter SOC_DMEM_SIZE = 32*1024;   // 32KB  
 
     parameter SOC_MEM_ADDR = 32'h0001_0000;
+`ifdef SOC_MEM_SIZE_BYTES
+    parameter SOC_MEM_SIZE = `SOC_MEM_SIZE_BYTES;
+`else
     parameter SOC_MEM_SIZE = 64*1024;       // 64KB
+`endif
 
     parameter SOC_RESET_ADDR = SOC_MEM_ADDR;
+
+    // Machine timer (CLINT layout)
+    parameter SOC_CLINT_ADDR = 32'h0200_0000;
+    parameter SOC_CLINT_SIZE = 32'h0001_0000;
 endpackage
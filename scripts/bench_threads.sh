@@ -0,0 +1,73 @@
+#! /bin/bash
+################################################################################
+# A script to benchmark multithreaded orionsim builds on CoreMark
+#
+# Builds orionsim once per thread count (sim/build/threads_<N>), runs CoreMark
+# on each build and reports the simulation speed (simulated kHz).
+################################################################################
+set -e      # Exit immediately if a command exits with a non-zero status
+
+if [ -z "${ORION_HOME}" ]; then
+    echo "ORION_HOME not set, did you source the sourceme script?"
+    exit 1
+fi
+
+# Default values
+THREAD_COUNTS="1 2 4 8"
+MAX_CYCLES=1000000000
+BENCH_DIR=${ORION_HOME}/sw/ex/coremark
+BENCH_ELF=${BENCH_DIR}/build/coremark.elf
+ORIONSIM_FLAGS=''
+
+# Simple CLI override parsing
+while [[ $# -gt 0 ]]; do
+    case "$1" in
+        --threads)
+            THREAD_COUNTS="$2"
+            shift 2
+            ;;
+        --max-cycles)
+            MAX_CYCLES="$2"
+            shift 2
+            ;;
+        --orionsim-flags)
+            ORIONSIM_FLAGS="${ORIONSIM_FLAGS} $2"
+            shift 2
+            ;;
+        *)
+            echo "Unknown option: $1" >&2
+            exit 1
+            ;;
+    esac
+done
+
+# Build the benchmark
+echo "[+] Building CoreMark"
+make -C ${ORION_HOME}/sw/lib > /dev/null
+make -C ${BENCH_DIR} build > /dev/null
+
+declare -A bench_khz
+declare -A bench_cycles
+
+for n in ${THREAD_COUNTS}; do
+    build_dir=build/threads_${n}
+    echo "[+] Building orionsim (threads: ${n})"
+    make -C ${ORION_HOME}/sim THREADS=${n} BUILD_DIR=${build_dir} > /dev/null
+
+    echo "[+] Running CoreMark (threads: ${n})"
+    out=$(${ORION_HOME}/sim/${build_dir}/bin/orionsim --threads ${n} --max-cycles ${MAX_CYCLES} ${ORIONSIM_FLAGS} ${BENCH_ELF} || true)
+    bench_khz[$n]=$(echo "$out" | grep -oP 'Simulation speed: \K[0-9.]+')
+    bench_cycles[$n]=$(echo "$out" | grep -oP 'Cycles: \K[0-9]+')
+done
+
+# Final report
+first=$(echo ${THREAD_COUNTS} | awk '{print $1}')
+echo "---------------------------------------"
+echo "        Orionsim Thread Scaling        "
+echo "---------------------------------------"
+printf " %-8s %-14s %-12s %s\n" "Threads" "Cycles" "Speed (kHz)" "Speedup"
+for n in ${THREAD_COUNTS}; do
+    speedup=$(awk -v a="${bench_khz[$n]}" -v b="${bench_khz[$first]}" 'BEGIN { if (b > 0) printf "%.2fx", a / b; else print "-" }')
+    printf " %-8s %-14s %-12s %s\n" "$n" "${bench_cycles[$n]}" "${bench_khz[$n]}" "$speedup"
+done
+echo "---------------------------------------"
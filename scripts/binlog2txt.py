@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+################################################################################
+# Convert an orionsim binary log (--log-format bin) to a text log
+#
+#   orionsim --log build/prog.blog --log-format bin build/prog.elf
+#   binlog2txt.py build/prog.blog -f spike -o build/prog.log
+#
+# The output matches the log orionsim writes with --log-format default/spike.
+# Compressed logs (.gz, .zst with the zstandard module) are read directly, '-'
+# reads stdin (e.g. zstd -dc build/prog.blog.zst | binlog2txt.py -).
+# The record layout is described in sim/bin_log.h.
+################################################################################
+import sys
+import gzip
+import struct
+import argparse
+
+MAGIC           = b'ORIONLOG'
+VERSION         = 1
+RECORD          = struct.Struct('<8I5B3x')
+CHUNK_RECORDS   = 1 << 15
+
+FLAG_VALID      = 1 << 0
+FLAG_RD_WE      = 1 << 1
+FLAG_SKIP       = 1 << 2
+
+M32             = 0xffffffff
+
+
+def records(f):
+    # Yields the records with absolute cycle, pc and memory address
+    hdr = f.read(16)
+    if len(hdr) != 16 or hdr[:8] != MAGIC:
+        raise ValueError("not an orionsim binary log")
+    version, size = struct.unpack('<II', hdr[8:])
+    if version != VERSION or size != RECORD.size:
+        raise ValueError(f"unsupported binary log version {version} (record size {size})")
+
+    cycle, pc, mem_addr = 0, 0, 0
+    while True:
+        chunk = f.read(RECORD.size * CHUNK_RECORDS)
+        while len(chunk) % RECORD.size:
+            # Decompressors may return short reads
+            more = f.read(RECORD.size - len(chunk) % RECORD.size)
+            if not more:
+                raise ValueError("truncated binary log")
+            chunk += more
+        if not chunk:
+            break
+        for (cycle_d, pc_d, instr, rd_v, rs1_v, rs2_v, mem_addr_d, mem_data,
+                rd_s, rs1_s, rs2_s, flags, masks) in RECORD.iter_unpack(chunk):
+            cycle += cycle_d
+            if flags & FLAG_SKIP:
+                continue
+            pc = (pc + pc_d) & M32
+            if masks:
+                mem_addr = (mem_addr + mem_addr_d) & M32
+            yield (cycle, flags, pc, instr, rd_s, rd_v, rs1_s, rs1_v, rs2_s, rs2_v,
+                   mem_addr, mem_data, masks & 0xf, masks >> 4)
+
+
+def open_log(path):
+    # Binary log file object, decompressed according to the extension
+    if path == '-':
+        return sys.stdin.buffer
+    if path.endswith('.gz'):
+        return gzip.open(path, 'rb')
+    if path.endswith('.zst'):
+        try:
+            import zstandard
+        except ImportError:
+            raise ValueError("reading .zst needs the zstandard module (or: zstd -dc FILE | binlog2txt.py -)")
+        return zstandard.ZstdDecompressor().stream_reader(open(path, 'rb'))
+    return open(path, 'rb')
+
+
+def masked_hexstr(data, mask):
+    # Bytes selected by mask, MSB first
+    return ''.join('%02x' % ((data >> (i * 8)) & 0xff) for i in range(3, -1, -1) if mask & (1 << i))
+
+
+def format_default(r):
+    cycle, flags, pc, instr, rd_s, rd_v, rs1_s, rs1_v, rs2_s, rs2_v, _, _, _, _ = r
+    return ("[%8d] %s PC: 0x%08x, Instr: 0x%08x, rd: (x%-2d: 0x%08x, we: %d), rs1: (x%-2d: 0x%08x), rs2: (x%-2d: 0x%08x) \n" %
+            (cycle, "       " if flags & FLAG_VALID else "INVALID", pc, instr,
+             rd_s, rd_v, 1 if flags & FLAG_RD_WE else 0, rs1_s, rs1_v, rs2_s, rs2_v))
+
+
+def format_spike(r):
+    _, flags, pc, instr, rd_s, rd_v, _, _, _, _, mem_addr, mem_data, rmask, wmask = r
+    if not flags & FLAG_VALID:
+        return None
+    line = "core   0: 3 0x%08x (0x%08x)" % (pc, instr)
+    if rmask:
+        line += " x%-2d 0x%08x mem 0x%08x" % (rd_s, mem_data, mem_addr)
+    elif wmask:
+        line += " mem 0x%08x 0x%s" % (mem_addr, masked_hexstr(mem_data, wmask))
+    elif flags & FLAG_RD_WE and rd_s != 0:
+        line += " x%-2d 0x%08x" % (rd_s, rd_v)
+    return line + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert an orionsim binary log to a text log")
+    parser.add_argument('log', help="Binary log file (.gz/.zst compressed, '-' for stdin)")
+    parser.add_argument('-f', '--format', choices=['default', 'spike'], default='default', help="Text log format")
+    parser.add_argument('-o', '--output', help="Output file (default: stdout)")
+    args = parser.parse_args()
+
+    fmt = format_spike if args.format == 'spike' else format_default
+    out = open(args.output, 'w') if args.output else sys.stdout
+    try:
+        with open_log(args.log) as f:
+            buf = []
+            for r in records(f):
+                line = fmt(r)
+                if line is not None:
+                    buf.append(line)
+                if len(buf) >= 65536:
+                    out.write(''.join(buf))
+                    buf = []
+            out.write(''.join(buf))
+    except ValueError as e:
+        print(f"Error: {args.log}: {e}", file=sys.stderr)
+        return 1
+    finally:
+        if out is not sys.stdout:
+            out.close()
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
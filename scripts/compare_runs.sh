@@ -0,0 +1,132 @@
+#! /bin/bash
+################################################################################
+# A script to check that orionsim options do not change what a program does:
+# runs the program once without and once with each set of flags, and compares
+# the results of the runs
+################################################################################
+# set -x      # Print each command before executing it (For debuigging)
+
+# Define colors for output
+CLR_RD="\033[0;31m"
+CLR_GR="\033[0;32m"
+CLR_NC="\033[0m"
+
+if ! command -v orionsim > /dev/null 2>&1; then
+    printf "${CLR_RD}ERROR:${CLR_NC} orionsim could not be found\n"
+    exit 1
+fi
+
+# Default values
+ELF=None
+BUILD_DIR=build
+ORIONSIM_FLAGS=''
+COMPARE_FLAGS=''                            # Flag sets, separated by ';'
+CHECK='retcode,cycles,instret,console,mem'  # Results compared
+
+# Simple CLI override parsing
+while [[ $# -gt 0 ]]; do
+    case "$1" in
+        --elf)
+            ELF="$2"
+            shift 2
+            ;;
+        --build-dir)
+            BUILD_DIR="$2"
+            shift 2
+            ;;
+        --orionsim-flags)
+            ORIONSIM_FLAGS="${ORIONSIM_FLAGS} $2"
+            shift 2
+            ;;
+        --compare-flags)
+            COMPARE_FLAGS="$2"
+            shift 2
+            ;;
+        --check)
+            CHECK="$2"
+            shift 2
+            ;;
+        *)
+            echo "Unknown option: $1" >&2
+            exit 1
+            ;;
+    esac
+done
+
+if [ "$ELF" == "None" ]; then
+    echo "No ELF file provided. Please provide an ELF file using --elf option."
+    exit 1
+fi
+if [ -z "$COMPARE_FLAGS" ]; then
+    echo "No flags to compare. Please provide them using --compare-flags option."
+    exit 1
+fi
+
+# Run orionsim (name, flags...), the results go to ${BUILD_DIR}/<name>.res
+run() {
+    local name=$1
+    shift
+    local out=${BUILD_DIR}/${name}.out
+    local mem=${BUILD_DIR}/${name}.mem
+    local res=${BUILD_DIR}/${name}.res
+
+    # The run report is needed whatever the verbosity of ORIONSIM_FLAGS
+    echo "$ orionsim ${ORIONSIM_FLAGS} $* --verbosity 2 --dump-mem ${mem} ${ELF}"
+    orionsim ${ORIONSIM_FLAGS} "$@" --verbosity 2 --dump-mem ${mem} ${ELF} > ${out} 2>&1
+    local rc=$?
+
+    : > ${res}
+    for check in ${CHECK//,/ }; do
+        case "$check" in
+            retcode)
+                echo "retcode: ${rc}" >> ${res}
+                ;;
+            cycles)
+                grep -E '^\[\+\] Cycles:' ${out} | sed 's/ (Time.*//' >> ${res}
+                ;;
+            instret)
+                grep -E '^\[\+\] Instructions executed:' ${out} >> ${res}
+                ;;
+            console)
+                # Everything orionsim did not print itself
+                grep -vE '^\[' ${out} >> ${res}
+                ;;
+            mem)
+                echo "mem: $(md5sum < ${mem} | cut -d' ' -f1)" >> ${res}
+                ;;
+            *)
+                echo "Unknown check: $check" >&2
+                exit 1
+                ;;
+        esac
+    done
+    return ${rc}
+}
+
+mkdir -p ${BUILD_DIR}
+
+echo "Running the reference (ELF: ${ELF})"
+if ! run ref; then
+    cat ${BUILD_DIR}/ref.out
+    printf "${CLR_RD}[!] Comparison failed: the reference run did not pass${CLR_NC}\n"
+    exit 1
+fi
+
+failed=0
+i=0
+IFS=';' read -ra flag_sets <<< "$COMPARE_FLAGS"
+for flags in "${flag_sets[@]}"; do
+    ((i++))
+    echo "Running with: ${flags}"
+    run "cmp${i}" ${flags}
+    if ! diff ${BUILD_DIR}/ref.res ${BUILD_DIR}/cmp${i}.res; then
+        printf "${CLR_RD}[!] Results differ with: ${flags}${CLR_NC}\n"
+        failed=1
+    fi
+done
+
+if [ $failed -ne 0 ]; then
+    printf "${CLR_RD}[!] Comparison failed: Differences found${CLR_NC}\n"
+    exit 1
+fi
+printf "${CLR_GR}[+] Comparison success: Same results with all flags${CLR_NC}\n"
@@ -6,9 +6,20 @@ if ((BASH_VERSINFO[0] < 4)); then
     exit 1
 fi
 
+# --batch: run all tests through a single orionsim process (no spike verification)
+BATCH=0
+if [ "$1" == "--batch" ]; then
+    BATCH=1
+fi
+
 TEST_LOG="${ORION_HOME}/test.log"
 : > "$TEST_LOG"
 
+BATCH_MANIFEST="${ORION_HOME}/test.manifest"
+if [ $BATCH -eq 1 ]; then
+    : > "$BATCH_MANIFEST"
+fi
+
 declare -A test_results
 
 n_total=0
@@ -29,9 +40,17 @@ echo "[+] Running Orion tests"
             printf "\n------------------------------------------------------------\n"
             printf "[+] Compiling test: $testname\n"
             make -C "$testdir" clean build
+
+            if [ $BATCH -eq 1 ]; then
+                # Add test to the batch manifest, run later
+                make -s --no-print-directory -C "$testdir" batch-entry >> "$BATCH_MANIFEST"
+                test_results["$testname"]="FAIL"
+                continue
+            fi
+
             printf "\n[+] Running test: $testname\n"
 
-            if make -C "$testdir" run-verif ORIONSIM_FLAGS="--verbosity 1"; then
+            if make -C "$testdir" test ORIONSIM_FLAGS="--verbosity 1"; then
                 test_results["$testname"]="PASS"
             else
                 test_results["$testname"]="FAIL"
@@ -39,6 +58,20 @@ echo "[+] Running Orion tests"
             fi
         fi
     done
+
+    if [ $BATCH -eq 1 ]; then
+        printf "\n------------------------------------------------------------\n"
+        printf "[+] Running batch: $BATCH_MANIFEST\n"
+        n_failed=$n_total
+        while read -r status progfile; do
+            # Result lines: [batch] <PASS|FAIL> ... <progfile>
+            testname=$(basename "$(dirname "$(dirname "$progfile")")")
+            test_results["$testname"]="$status"
+            if [ "$status" == "PASS" ]; then
+                ((n_failed--))
+            fi
+        done < <(orionsim --verbosity 1 --batch "$BATCH_MANIFEST" | tee /dev/stderr | awk '$1 == "[batch]" && ($2 == "PASS" || $2 == "FAIL") {print $2, $NF}')
+    fi
 } > "$TEST_LOG" 2>&1
 echo "[+] Tests completed (total: $n_total)"
 
@@ -0,0 +1,235 @@
+#!/usr/bin/env python3
+################################################################################
+# SimPoint-style sampled simulation for orionsim
+#
+# 1) Profile basic block vectors:
+#   orionsim --bbv build/prog.bb --bbv-interval 1000000 build/prog.elf
+#
+# 2) Cluster the intervals and pick one simulation point per cluster:
+#   simpoint.py cluster build/prog.bb -o build/prog
+#   (writes build/prog.simpoints and build/prog.weights in SimPoint format)
+#
+# 3) Simulate only the simulation points and extrapolate cycles/IPC:
+#   simpoint.py run build/prog.elf --bbv build/prog.bb --points build/prog \
+#       --interval 1000000 --warmup 100000
+#
+# Each simulation point is fast-forwarded on the built-in ISS to its start
+# (minus the warm-up), then simulated in RTL; the region of interest gives the
+# cycles of the interval.
+################################################################################
+import os
+import re
+import sys
+import math
+import random
+import argparse
+import subprocess
+from concurrent.futures import ThreadPoolExecutor
+
+PROJ_DIMS       = 15        # Random projection dimensions (as SimPoint)
+BIC_THRESHOLD   = 0.9       # Pick the smallest k with BIC >= 90% of the range
+
+
+def read_bbv(filename):
+    # Returns a list of {bb-id: count} per interval
+    vectors = []
+    with open(filename) as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith('T'):
+                continue
+            vec = {}
+            for tok in line[1:].split():
+                _, bb, count = tok.split(':')
+                vec[int(bb)] = int(count)
+            vectors.append(vec)
+    return vectors
+
+
+def project(vectors, dims, seed):
+    # Normalize each vector and project it to a few random dimensions
+    rng = random.Random(seed)
+    proj = {}
+    points = []
+    for vec in vectors:
+        total = sum(vec.values()) or 1
+        p = [0.0] * dims
+        for bb, count in vec.items():
+            if bb not in proj:
+                proj[bb] = [rng.uniform(-1, 1) for _ in range(dims)]
+            w = count / total
+            for d in range(dims):
+                p[d] += w * proj[bb][d]
+        points.append(p)
+    return points
+
+
+def dist2(a, b):
+    return sum((x - y) ** 2 for x, y in zip(a, b))
+
+
+def kmeans(points, k, seed, iters=100):
+    # Returns (labels, centers)
+    rng = random.Random(seed)
+    centers = [list(p) for p in rng.sample(points, k)]
+    labels = [0] * len(points)
+    for _ in range(iters):
+        new_labels = [min(range(k), key=lambda c: dist2(p, centers[c])) for p in points]
+        for c in range(k):
+            members = [p for p, l in zip(points, new_labels) if l == c]
+            if members:
+                centers[c] = [sum(x) / len(members) for x in zip(*members)]
+        if new_labels == labels:
+            break
+        labels = new_labels
+    return labels, centers
+
+
+def bic(points, labels, centers):
+    # Bayesian information criterion of a spherical gaussian clustering (X-means)
+    r, m, k = len(points), len(points[0]), len(centers)
+    if r <= k:
+        return float('-inf')
+    var = sum(dist2(p, centers[l]) for p, l in zip(points, labels)) / (r - k)
+    var = max(var, 1e-12)
+    loglik = 0.0
+    for c in range(k):
+        rn = labels.count(c)
+        if rn == 0:
+            continue
+        loglik += (rn * math.log(rn) - rn * math.log(r) - rn / 2 * math.log(2 * math.pi)
+                   - rn * m / 2 * math.log(var) - (rn - k) / 2)
+    nparams = (k - 1) + m * k + 1
+    return loglik - nparams / 2 * math.log(r)
+
+
+def cluster(args):
+    vectors = read_bbv(args.bbv)
+    if not vectors:
+        print(f"ERROR: No basic block vectors in {args.bbv}", file=sys.stderr)
+        return 1
+    points = project(vectors, PROJ_DIMS, args.seed)
+
+    # Cluster for each k (best of a few seeds) and score with BIC
+    results = []
+    for k in range(1, min(args.max_k, len(points)) + 1):
+        best = None
+        for s in range(args.seeds):
+            labels, centers = kmeans(points, k, args.seed + s)
+            dist = sum(dist2(p, centers[l]) for p, l in zip(points, labels))
+            if best is None or dist < best[0]:
+                best = (dist, labels, centers)
+        results.append((k, bic(points, best[1], best[2]), best[1], best[2]))
+
+    finite = [b for _, b, _, _ in results if b != float('-inf')]
+    lo, hi = (min(finite), max(finite)) if finite else (0, 0)
+    k, _, labels, centers = next(r for r in results if r[1] != float('-inf') and r[1] >= lo + BIC_THRESHOLD * (hi - lo)) \
+        if finite else results[0]
+
+    # One simulation point per cluster: the interval closest to the center
+    with open(args.output + '.simpoints', 'w') as fsp, open(args.output + '.weights', 'w') as fw:
+        for c in range(k):
+            members = [i for i, l in enumerate(labels) if l == c]
+            if not members:
+                continue
+            point = min(members, key=lambda i: dist2(points[i], centers[c]))
+            fsp.write(f"{point} {c}\n")
+            fw.write(f"{len(members) / len(points):.6f} {c}\n")
+            print(f"[+] Cluster {c}: {len(members)} intervals, simulation point: {point}")
+
+    print(f"[+] Intervals: {len(points)}, clusters: {k}")
+    print(f"[+] Wrote {args.output}.simpoints and {args.output}.weights")
+    return 0
+
+
+def read_points(prefix):
+    # Returns a list of (interval, weight)
+    points, weights = {}, {}
+    with open(prefix + '.simpoints') as f:
+        for line in f:
+            interval, c = line.split()
+            points[int(c)] = int(interval)
+    with open(prefix + '.weights') as f:
+        for line in f:
+            w, c = line.split()
+            weights[int(c)] = float(w)
+    return [(points[c], weights[c]) for c in sorted(points)]
+
+
+def simulate_point(args, interval):
+    # Simulate one interval: fast-forward, warm up, then measure the interval
+    start = interval * args.interval
+    ff = max(0, start - args.warmup)
+    cmd = [args.orionsim, '--max-cycles', str(args.max_cycles),
+           '--roi-start', str(start), '--max-instret', str(start + args.interval)]
+    if ff > 0:
+        cmd += ['--fast-forward', str(ff)]
+    cmd += args.orionsim_flags.split() + [args.program]
+    out = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True).stdout
+    m = re.search(r'ROI cycles: (\d+), ROI instructions: (\d+)', out)
+    if not m:
+        print(f"ERROR: No ROI stats for interval {interval}:\n{out}", file=sys.stderr)
+        return None
+    return int(m.group(1)), int(m.group(2))
+
+
+def run(args):
+    points = read_points(args.points)
+    total_instrs = sum(sum(vec.values()) for vec in read_bbv(args.bbv))
+
+    with ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        stats = list(pool.map(lambda p: simulate_point(args, p[0]), points))
+
+    print("---------------------------------------------------------------")
+    print("                  SimPoint Sampled Simulation                  ")
+    print("---------------------------------------------------------------")
+    print(f" {'Interval':<10} {'Weight':<10} {'Cycles':<14} {'Instret':<14} {'IPC'}")
+    cpi, wsum = 0.0, 0.0
+    for (interval, weight), st in zip(points, stats):
+        if st is None or st[1] == 0:
+            print(f" {interval:<10} {weight:<10.4f} {'-':<14} {'-':<14} -")
+            continue
+        cycles, instret = st
+        print(f" {interval:<10} {weight:<10.4f} {cycles:<14} {instret:<14} {instret / cycles:.4f}")
+        cpi += weight * cycles / instret
+        wsum += weight
+    print("---------------------------------------------------------------")
+    if wsum == 0:
+        print("ERROR: No simulation point completed", file=sys.stderr)
+        return 1
+    cpi /= wsum
+    print(f" Instructions (profiled): {total_instrs}")
+    print(f" Estimated cycles       : {int(total_instrs * cpi)}")
+    print(f" Estimated IPC          : {1 / cpi:.6f}")
+    print("---------------------------------------------------------------")
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="SimPoint-style sampled simulation for orionsim")
+    sub = parser.add_subparsers(dest='cmd', required=True)
+
+    p = sub.add_parser('cluster', help="Cluster basic block vectors and pick simulation points")
+    p.add_argument('bbv', help="Basic block vector file (orionsim --bbv)")
+    p.add_argument('-o', '--output', required=True, help="Output prefix (<prefix>.simpoints, <prefix>.weights)")
+    p.add_argument('--max-k', type=int, default=10, help="Maximum number of clusters (default: 10)")
+    p.add_argument('--seeds', type=int, default=5, help="k-means runs per k (default: 5)")
+    p.add_argument('--seed', type=int, default=1, help="Random seed (default: 1)")
+
+    p = sub.add_parser('run', help="Simulate the simulation points and extrapolate cycles/IPC")
+    p.add_argument('program', help="Program file (ELF or hex)")
+    p.add_argument('--bbv', required=True, help="Basic block vector file the points were picked from")
+    p.add_argument('--points', required=True, help="Prefix of the .simpoints/.weights files")
+    p.add_argument('--interval', type=int, required=True, help="Interval length used for profiling (instructions)")
+    p.add_argument('--warmup', type=int, default=0, help="Warm-up instructions simulated in RTL before each interval")
+    p.add_argument('-j', '--jobs', type=int, default=os.cpu_count(), help="Simulation points simulated concurrently")
+    p.add_argument('--max-cycles', type=int, default=1000000000000, help="orionsim --max-cycles")
+    p.add_argument('--orionsim', default='orionsim', help="orionsim executable")
+    p.add_argument('--orionsim-flags', default='', help="Extra orionsim flags")
+
+    args = parser.parse_args()
+    return cluster(args) if args.cmd == 'cluster' else run(args)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
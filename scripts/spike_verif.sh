@@ -73,14 +73,9 @@ echo "$ spike ${SPIKE_FLAGS} ${ELF}"
 spike ${SPIKE_FLAGS} ${ELF} 2>&1 | tail -n +6 > ${SPIKE_LOG}
 
 # Execute orionsim
-EXEC_HEX=${BUILD_DIR}/$(basename "${ELF}" .elf).hex
-if [ ! -f ${EXEC_HEX} ]; then
-    echo "Error: ${EXEC_HEX} not found. (required for orionsim)"
-    exit 1
-fi
-echo "Running Orionsim (Hex: ${EXEC_HEX})"
-echo "$ orionsim ${ORIONSIM_FLAGS} ${EXEC_HEX}"
-orionsim ${ORIONSIM_FLAGS} ${EXEC_HEX} || true
+echo "Running Orionsim (ELF: ${ELF})"
+echo "$ orionsim ${ORIONSIM_FLAGS} ${ELF}"
+orionsim ${ORIONSIM_FLAGS} ${ELF} || true
 
 # Check if the logs are identical
 diff -y --suppress-common-lines --width=140 ${SPIKE_LOG} ${ORIONSIM_LOG} | expand -t 8 > ${DIFF_FILE}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "commit_stream.h"
+
+/*
+    Bbv: Basic block vector profiler
+    ================================
+    Builds basic-block vectors from the retired instruction stream, one vector
+    per interval of a fixed number of instructions, and writes them in the
+    SimPoint frequency vector format (one line per interval):
+
+        T:<bb-id>:<count> :<bb-id>:<count> ...
+
+    where count is the number of instructions executed in the basic block
+    (identified by its start PC) during the interval. A basic block ends at a
+    branch/jump or at an interval boundary. The start PC of each bb-id is
+    written to <file>.map ("<bb-id> <pc>" per line). It runs as a consumer of
+    the commit stream.
+*/
+class Bbv: public CommitConsumer {
+public:
+    ~Bbv() { close(); }
+
+    bool open(const std::string &filename, uint64_t interval) {
+        bb_f = fopen(filename.c_str(), "w");
+        if(!bb_f) {
+            return false;
+        }
+        map_file = filename + ".map";
+        interval_len = interval;
+        interval_left = interval;
+        return true;
+    }
+
+    void close() {
+        if(!bb_f) {
+            return;
+        }
+        // Last (partial) interval
+        if(interval_left != interval_len) {
+            end_block();
+            dump_interval();
+        }
+        fclose(bb_f);
+        bb_f = nullptr;
+
+        // BB-id to PC map
+        FILE *map_f = fopen(map_file.c_str(), "w");
+        if(map_f) {
+            for(auto &bb: bb_ids) {
+                fprintf(map_f, "%u 0x%08x\n", bb.second, bb.first);
+            }
+            fclose(map_f);
+        }
+    }
+
+    // Record one retired instruction
+    inline void retire(uint32_t pc, uint32_t instr) {
+        if(bb_len == 0) {
+            bb_start = pc;
+        }
+        bb_len++;
+
+        // Branches, JAL and JALR end the basic block
+        uint32_t opcode = instr & 0x7f;
+        if(opcode == 0x63 || opcode == 0x6f || opcode == 0x67) {
+            end_block();
+        }
+
+        if(--interval_left == 0) {
+            end_block();
+            dump_interval();
+            interval_left = interval_len;
+        }
+    }
+
+    void consume(const Commit_t *c, size_t n) override {
+        for(size_t i = 0; i < n; i++) {
+            if(c[i].valid) {
+                retire(c[i].pc, c[i].instr);
+            }
+        }
+    }
+
+    void finish() override { close(); }
+
+    uint64_t get_nintervals() { return nintervals; }
+
+private:
+    void end_block() {
+        if(bb_len == 0) {
+            return;
+        }
+        auto it = bb_ids.find(bb_start);
+        uint32_t id;
+        if(it == bb_ids.end()) {
+            id = bb_ids.size() + 1;     // SimPoint ids start at 1
+            bb_ids[bb_start] = id;
+            counts.push_back(0);
+        }
+        else {
+            id = it->second;
+        }
+        if(counts[id - 1] == 0) {
+            touched.push_back(id);
+        }
+        counts[id - 1] += bb_len;
+        bb_len = 0;
+    }
+
+    void dump_interval() {
+        fprintf(bb_f, "T");
+        for(uint32_t id: touched) {
+            fprintf(bb_f, ":%u:%lu ", id, counts[id - 1]);
+            counts[id - 1] = 0;
+        }
+        fprintf(bb_f, "\n");
+        touched.clear();
+        nintervals++;
+    }
+
+    FILE        *bb_f = nullptr;
+    std::string  map_file;
+
+    uint64_t interval_len  = 0;
+    uint64_t interval_left = 0;
+    uint64_t nintervals    = 0;
+
+    // Current basic block
+    uint32_t bb_start = 0;
+    uint64_t bb_len   = 0;
+
+    std::unordered_map<uint32_t, uint32_t> bb_ids;    // start PC -> bb-id
+    std::vector<uint64_t> counts;                     // per bb-id, current interval
+    std::vector<uint32_t> touched;                    // bb-ids counted in the current interval
+};
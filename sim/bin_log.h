@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "commit_stream.h"
+#include "log_writer.h"
+
+/*
+    BinLog: binary simulation log (--log-format bin)
+    ================================================
+    Writes the simulation log as fixed-size little endian records through a
+    LogWriter (large buffer, optional compression), instead of a formatted
+    text line per cycle (a consumer of the commit stream).
+    scripts/binlog2txt.py converts it back to the default and spike formats.
+
+    File: header {"ORIONLOG", u32 version, u32 record size}, then one record
+    per logged cycle:
+
+    -------+------+-----------------------------------------------------------
+    Offset | Type | Field
+    -------+------+-----------------------------------------------------------
+    0      | u32  | Cycles since the previous record
+    4      | u32  | PC - PC of the previous record
+    8      | u32  | Instruction
+    12     | u32  | rd value
+    16     | u32  | rs1 value
+    20     | u32  | rs2 value
+    24     | u32  | Memory address - address of the previous memory access
+    28     | u32  | Memory data (loaded data if rmask, else stored data)
+    32     | u8   | rd
+    33     | u8   | rs1
+    34     | u8   | rs2
+    35     | u8   | Flags: [0] valid, [1] rd write enable, [2] skip
+    36     | u8   | Masks: [3:0] load mask, [7:4] store mask
+    37     | u8x3 | Padding
+    -------+------+-----------------------------------------------------------
+
+    The deltas start from 0. A skip record only advances the cycle count (a
+    gap longer than 2^32 - 1 cycles), it is not a logged cycle.
+*/
+class BinLog: public CommitConsumer {
+public:
+    enum {
+        VERSION     = 1,
+
+        FLAG_VALID  = 1 << 0,
+        FLAG_RD_WE  = 1 << 1,
+        FLAG_SKIP   = 1 << 2
+    };
+
+    ~BinLog() { close(); }
+
+    // Start writing to w (not owned), writes the header
+    void open(LogWriter *w) {
+        close();
+        log_w = w;
+        const char magic[8] = {'O', 'R', 'I', 'O', 'N', 'L', 'O', 'G'};
+        uint32_t hdr[2] = {VERSION, sizeof(Record_t)};
+        log_w->write(magic, sizeof(magic));
+        log_w->write(hdr, sizeof(hdr));
+        last_cycle = 0;
+        last_pc = 0;
+        last_mem_addr = 0;
+    }
+
+    // Stop writing (the writer stays open)
+    void close() {
+        log_w = nullptr;
+    }
+
+    bool is_open() { return log_w != nullptr; }
+
+    void consume(const Commit_t *c, size_t n) override {
+        for(size_t i = 0; i < n; i++) {
+            append(c[i]);
+        }
+    }
+
+    void finish() override { close(); }
+
+    inline void append(const Commit_t &e) {
+        uint64_t delta = e.cycle - last_cycle;
+        while(delta > UINT32_MAX) {
+            Record_t skip = {};
+            skip.cycle_delta = UINT32_MAX;
+            skip.flags = FLAG_SKIP;
+            push(skip);
+            delta -= UINT32_MAX;
+        }
+
+        Record_t r;
+        r.cycle_delta = (uint32_t)delta;
+        r.pc_delta    = e.pc - last_pc;
+        r.instr       = e.instr;
+        r.rd_v        = e.rd_v;
+        r.rs1_v       = e.rs1_v;
+        r.rs2_v       = e.rs2_v;
+        r.mem_addr_delta = 0;
+        r.mem_data    = e.mem_rmask ? e.mem_rdata : e.mem_wdata;
+        r.rd_s        = e.rd_s;
+        r.rs1_s       = e.rs1_s;
+        r.rs2_s       = e.rs2_s;
+        r.flags       = (e.valid ? FLAG_VALID : 0) | (e.rd_we ? FLAG_RD_WE : 0);
+        r.masks       = (e.mem_rmask & 0xf) | ((e.mem_wmask & 0xf) << 4);
+        memset(r.pad, 0, sizeof(r.pad));
+        if(r.masks) {
+            r.mem_addr_delta = e.mem_addr - last_mem_addr;
+            last_mem_addr = e.mem_addr;
+        }
+        last_cycle = e.cycle;
+        last_pc = e.pc;
+        push(r);
+        log_w->record_done();
+    }
+
+private:
+    struct Record_t {
+        uint32_t cycle_delta;
+        uint32_t pc_delta;
+        uint32_t instr;
+        uint32_t rd_v;
+        uint32_t rs1_v;
+        uint32_t rs2_v;
+        uint32_t mem_addr_delta;
+        uint32_t mem_data;
+        uint8_t  rd_s;
+        uint8_t  rs1_s;
+        uint8_t  rs2_s;
+        uint8_t  flags;
+        uint8_t  masks;
+        uint8_t  pad[3];
+    };
+    static_assert(sizeof(Record_t) == 40, "BinLog record layout");
+
+    inline void push(const Record_t &r) {
+        log_w->write(&r, sizeof(r));
+    }
+
+    LogWriter *log_w = nullptr;
+
+    uint64_t last_cycle    = 0;
+    uint32_t last_pc       = 0;
+    uint32_t last_mem_addr = 0;
+};
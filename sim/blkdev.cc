@@ -0,0 +1,108 @@
+#include "blkdev.h"
+
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+bool BlkDev::open(const std::string &filename) {
+    close();
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd < 0) {
+        return false;
+    }
+    struct stat sb;
+    if(fstat(fd, &sb) != 0) {
+        int err = errno;
+        close();
+        errno = err;
+        return false;
+    }
+    file_size = sb.st_size;
+    return true;
+}
+
+void BlkDev::close() {
+    if(fd >= 0) {
+        ::close(fd);
+        fd = -1;
+        file_size = 0;
+    }
+}
+
+uint32_t BlkDev::read(uint32_t offset) {
+    // Status is derived from the cycle count, so polling it has no side effects
+    switch(offset) {
+        case SECTOR:    return st.sector;
+        case ADDR:      return st.addr;
+        case LEN:       return st.len;
+        case STATUS: {
+            uint32_t status = st.error ? STATUS_ERROR : 0;
+            if(st.active) {
+                status |= host->blk_cycles() < st.done_at ? STATUS_BUSY : STATUS_DONE;
+            }
+            return status;
+        }
+        case NSECTORS:  return (uint32_t)((file_size + SECTOR_BYTES - 1) / SECTOR_BYTES);
+        default:        return 0;
+    }
+}
+
+void BlkDev::write(uint32_t offset, uint32_t data, uint8_t mask) {
+    uint32_t *reg;
+    switch(offset) {
+        case SECTOR:    reg = &st.sector; break;
+        case ADDR:      reg = &st.addr; break;
+        case LEN:       reg = &st.len; break;
+        case CMD:
+            if((mask & 0x1) && (data & 0xff) == CMD_READ) {
+                st.error = !start_read();
+            }
+            return;
+        default:
+            return;
+    }
+    for(int i = 0; i < 4; i++) {
+        if(mask & (1 << i)) {
+            *reg = (*reg & ~(0xffu << (i * 8))) | (data & (0xffu << (i * 8)));
+        }
+    }
+}
+
+bool BlkDev::start_read() {
+    uint64_t now = host->blk_cycles();
+    if(st.active && now < st.done_at) {
+        return false;
+    }
+    st.active = false;
+
+    uint64_t pos = (uint64_t)st.sector * SECTOR_BYTES;
+    if(pos >= file_size && st.len > 0) {
+        return false;
+    }
+    uint8_t *buf = host->blk_dma_begin(st.addr, st.len);
+    if(!buf) {
+        return false;
+    }
+    uint32_t done = 0;
+    while(done < st.len && pos + done < file_size) {
+        ssize_t n = pread(fd, buf + done, st.len - done, pos + done);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            host->blk_dma_end(st.addr, done);
+            return false;
+        }
+        done += n;
+    }
+    memset(buf + done, 0, st.len - done);
+    host->blk_dma_end(st.addr, st.len);
+
+    nrequests++;
+    nbytes += st.len;
+    st.active = true;
+    st.done_at = now + latency;
+    return true;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "mmio_bus.h"
+
+/*
+    BlkDev: host-backed block device
+    ================================
+    Read-only block device backed by a host file, for bulk input to the guest.
+    A command copies a region of the file straight into the guest memory
+    (DMA), and the device reports completion a configurable number of cycles
+    later.
+
+    -------+-----------+-------------------------------------------------
+    Offset | Name      | Description
+    -------+-----------+-------------------------------------------------
+    0x00   | SECTOR    | First sector to read (512 B sectors)
+    0x04   | ADDR      | Guest buffer address
+    0x08   | LEN       | Bytes to read
+    0x0C   | CMD       | Command register
+    0x10   | STATUS    | Status register (read-only)
+    0x14   | NSECTORS  | Size of the file in sectors (read-only)
+    0x18   | reserved  | --
+    0x1C   | reserved  | --
+    -------+-----------+-------------------------------------------------
+
+    Register Description
+    =======================
+    0x0C: CMD
+        Writing CMD_READ starts a read of LEN bytes from the file offset
+        SECTOR*512 into the guest memory at ADDR. Bytes past the end of the
+        file read as zeros.
+
+    0x10: STATUS
+        STATUS[0]:      Busy (a command is in flight)
+        STATUS[1]:      Done (the last command completed)
+        STATUS[2]:      Error (the last command was rejected: device busy,
+                        SECTOR past the end of the file, buffer outside
+                        the memory, or a host read error)
+
+    The data is in memory when the command is accepted; the guest must still
+    wait for STATUS.Done before using the buffer, as on a real device.
+*/
+class BlkDev: public MmioDevice {
+public:
+    enum {
+        SECTOR      = 0x00,
+        ADDR        = 0x04,
+        LEN         = 0x08,
+        CMD         = 0x0C,
+        STATUS      = 0x10,
+        NSECTORS    = 0x14,
+        SIZE        = 0x20,
+
+        SECTOR_BYTES = 512,
+
+        CMD_READ    = 1,
+
+        STATUS_BUSY  = 1 << 0,
+        STATUS_DONE  = 1 << 1,
+        STATUS_ERROR = 1 << 2
+    };
+
+    // Simulator side of the device
+    class Host {
+    public:
+        virtual ~Host() {}
+
+        virtual uint64_t blk_cycles() = 0;
+
+        // Guest memory of a transfer (nullptr if outside the memory), and its
+        // end (the memory was written)
+        virtual uint8_t *blk_dma_begin(uint32_t addr, uint32_t len) = 0;
+        virtual void blk_dma_end(uint32_t addr, uint32_t len) = 0;
+    };
+
+    BlkDev(Host *host): host(host) {}
+    ~BlkDev() { close(); }
+
+    // Open the backing file, returns false (errno set) on failure
+    bool open(const std::string &filename);
+    void close();
+    bool is_open() { return fd >= 0; }
+
+    // Cycles from a command to its completion
+    void set_latency(uint64_t cycles) { latency = cycles; }
+
+    uint32_t read(uint32_t offset) override;
+    void write(uint32_t offset, uint32_t data, uint8_t mask) override;
+
+    void reset() override { st = State_t(); }
+
+    void *get_state() override { return &st; }
+    size_t get_state_size() override { return sizeof(st); }
+
+    // Statistics
+    uint64_t get_requests() { return nrequests; }
+    uint64_t get_bytes() { return nbytes; }
+
+private:
+    // Start a read command, returns false if it is rejected
+    bool start_read();
+
+    Host    *host;
+    int      fd = -1;
+    uint64_t file_size = 0;
+    uint64_t latency   = 0;
+
+    uint64_t nrequests = 0;
+    uint64_t nbytes    = 0;
+
+    struct State_t {
+        uint32_t sector  = 0;
+        uint32_t addr    = 0;
+        uint32_t len     = 0;
+        bool     active  = false;   // A command was accepted (busy until done_at)
+        bool     error   = false;
+        uint64_t done_at = 0;       // Completion cycle of the last command
+    } st;
+};
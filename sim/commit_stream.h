@@ -0,0 +1,197 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+/*
+    CommitStream: retire records drained by consumer threads
+    ========================================================
+    The simulation thread (the single producer) writes one record per logged
+    cycle into a ring buffer, and each consumer (log writer, profiler) drains
+    the ring on its own thread, so the analyses attached to a run do not slow
+    down the model evaluation.
+
+    The ring is lock-free: the producer publishes its write index, each
+    consumer publishes its read index, and a slot is reused once every
+    consumer has read it. The write index is published every PUBLISH_RECORDS
+    records (and by flush()), so the consumers do not pull its cache line on
+    every cycle. When the ring is full the producer waits for the slowest
+    consumer (backpressure): no record is dropped. stop() lets the consumers
+    drain the ring, calls their finish() and joins them.
+*/
+
+// One logged cycle (retire stage)
+struct Commit_t {
+    uint64_t cycle;
+    uint32_t pc;
+    uint32_t instr;
+    uint32_t rd_v;
+    uint32_t rs1_v;
+    uint32_t rs2_v;
+    uint32_t mem_addr;
+    uint32_t mem_rdata;
+    uint32_t mem_wdata;
+    uint8_t  rd_s;
+    uint8_t  rs1_s;
+    uint8_t  rs2_s;
+    uint8_t  mem_rmask;
+    uint8_t  mem_wmask;
+    bool     rd_we;
+    bool     valid;
+};
+
+class CommitConsumer {
+public:
+    virtual ~CommitConsumer() {}
+
+    // Records in order (on the consumer thread)
+    virtual void consume(const Commit_t *c, size_t n) = 0;
+
+    // The stream ended, all records were consumed (on the consumer thread)
+    virtual void finish() {}
+};
+
+class CommitStream {
+public:
+    enum {
+        CAPACITY        = 1 << 16,  // Records in the ring (power of 2)
+        PUBLISH_RECORDS = 64,       // Records between write index updates
+        BATCH_RECORDS   = 4096,     // Most records handed to consume() at once
+        SPIN_POLLS      = 64        // Empty polls before a consumer sleeps
+    };
+
+    ~CommitStream() { stop(); }
+
+    // Register a consumer (not owned), before start()
+    void add(CommitConsumer *consumer) {
+        consumers.emplace_back(new Reader_t);
+        consumers.back()->consumer = consumer;
+    }
+
+    bool empty() { return consumers.empty(); }
+    bool is_running() { return running; }
+
+    // Start the consumer threads
+    void start() {
+        if(running || consumers.empty()) {
+            return;
+        }
+        ring.resize(CAPACITY);
+        done.store(false);
+        for(auto &r: consumers) {
+            Reader_t *reader = r.get();
+            reader->thread = std::thread([this, reader]() { drain(*reader); });
+        }
+        running = true;
+    }
+
+    // Drain the ring and stop the consumer threads
+    void stop() {
+        if(!running) {
+            return;
+        }
+        flush();
+        done.store(true, std::memory_order_release);
+        for(auto &r: consumers) {
+            r->thread.join();
+        }
+        running = false;
+    }
+
+    // Producer: the slot of the next record, then publish() it
+    inline Commit_t &next() {
+        if(head - free_from == CAPACITY) {
+            wait_space();
+        }
+        return ring[head & (CAPACITY - 1)];
+    }
+
+    inline void publish() {
+        head++;
+        if(head - published >= PUBLISH_RECORDS) {
+            flush();
+        }
+    }
+
+    // Publish the records written so far
+    void flush() {
+        published = head;
+        write_idx.store(head, std::memory_order_release);
+    }
+
+    // Statistics
+    uint64_t get_records() { return head; }
+    uint64_t get_waits() { return nwaits; }
+
+private:
+    struct Reader_t {
+        CommitConsumer       *consumer = nullptr;
+        std::thread           thread;
+        alignas(64) std::atomic<uint64_t> read_idx{0};
+    };
+
+    void wait_space() {
+        // Ring full: wait for the slowest consumer
+        flush();
+        nwaits++;
+        while(1) {
+            uint64_t tail = head;
+            for(auto &r: consumers) {
+                tail = std::min(tail, r->read_idx.load(std::memory_order_acquire));
+            }
+            if(head - tail < CAPACITY) {
+                free_from = tail;
+                return;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    void drain(Reader_t &reader) {
+        uint64_t tail = 0;
+        unsigned idle = 0;
+        while(1) {
+            uint64_t avail = write_idx.load(std::memory_order_acquire);
+            if(avail == tail) {
+                // Stop once the producer is done and everything was read
+                if(done.load(std::memory_order_acquire) && write_idx.load(std::memory_order_acquire) == tail) {
+                    break;
+                }
+                if(++idle < SPIN_POLLS) {
+                    std::this_thread::yield();
+                } else {
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+                continue;
+            }
+            idle = 0;
+            while(tail != avail) {
+                size_t offset = tail & (CAPACITY - 1);
+                size_t n = std::min<uint64_t>({avail - tail, (uint64_t)(CAPACITY - offset), (uint64_t)BATCH_RECORDS});
+                reader.consumer->consume(&ring[offset], n);
+                tail += n;
+                reader.read_idx.store(tail, std::memory_order_release);
+            }
+        }
+        reader.consumer->finish();
+    }
+
+    std::vector<Commit_t> ring;
+    std::vector<std::unique_ptr<Reader_t>> consumers;
+    bool running = false;
+
+    // Producer side
+    uint64_t head      = 0;     // Next record to write
+    uint64_t published = 0;     // Last published write index
+    uint64_t free_from = 0;     // Slowest read index seen (slots before it are free)
+    uint64_t nwaits    = 0;
+
+    alignas(64) std::atomic<uint64_t> write_idx{0};
+    alignas(64) std::atomic<bool>     done{false};
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*
+    Console: buffered guest console output
+    ======================================
+    Characters the guest writes to the console go into the stdout buffer
+    instead of being flushed one by one. The simulator log messages are
+    printed to the same buffer, so the two stay in order. The buffer is
+    flushed on newline, once FLUSH_SIZE characters are pending, every
+    FLUSH_INTERVAL_MS from a timer thread while the simulation runs, and on
+    exit (stdio).
+*/
+class Console {
+public:
+    enum {
+        FLUSH_SIZE          = 4096,     // Pending characters
+        FLUSH_INTERVAL_MS   = 100
+    };
+
+    ~Console() { stop(); }
+
+    // Start flushing periodically
+    void start() {
+        if(timer.joinable()) {
+            return;
+        }
+        stop_req = false;
+        timer = std::thread([this]() {
+            std::unique_lock<std::mutex> lock(mtx);
+            while(!cv.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL_MS), [this]() { return stop_req; })) {
+                fflush(stdout);
+            }
+        });
+    }
+
+    // Stop flushing periodically and flush the pending output
+    void stop() {
+        if(timer.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                stop_req = true;
+            }
+            cv.notify_one();
+            timer.join();
+        }
+        flush();
+    }
+
+    inline void putc(char c) {
+        putchar(c);
+        if(c == '\n' || ++pending >= FLUSH_SIZE) {
+            flush();
+        }
+    }
+
+    void flush() {
+        fflush(stdout);
+        pending = 0;
+    }
+
+private:
+    unsigned pending = 0;
+
+    std::thread             timer;
+    std::mutex              mtx;
+    std::condition_variable cv;
+    bool                    stop_req = false;
+};
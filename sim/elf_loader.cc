@@ -0,0 +1,84 @@
+#include "elf_loader.h"
+
+#include <elf.h>
+#include <cstring>
+#include <fstream>
+
+#ifndef EM_RISCV
+#define EM_RISCV 243
+#endif
+
+bool ElfLoader::is_elf(const std::string &filename) {
+    std::ifstream f(filename, std::ios::binary);
+    char magic[SELFMAG];
+    return f.read(magic, SELFMAG) && memcmp(magic, ELFMAG, SELFMAG) == 0;
+}
+
+bool ElfLoader::read(const std::string &filename) {
+    // Read the whole file
+    std::ifstream f(filename, std::ios::binary | std::ios::ate);
+    if(!f.is_open()) {
+        return fail("Could not open file");
+    }
+    buf.resize(f.tellg());
+    f.seekg(0);
+    if(!f.read((char *)buf.data(), buf.size())) {
+        return fail("Could not read file");
+    }
+
+    // Header
+    if(buf.size() < sizeof(Elf32_Ehdr) || memcmp(buf.data(), ELFMAG, SELFMAG) != 0) {
+        return fail("Not an ELF file");
+    }
+    const Elf32_Ehdr *eh = (const Elf32_Ehdr *)buf.data();
+    if(eh->e_ident[EI_CLASS] != ELFCLASS32 || eh->e_ident[EI_DATA] != ELFDATA2LSB) {
+        return fail("Not a 32-bit little-endian ELF file");
+    }
+    if(eh->e_machine != EM_RISCV) {
+        return fail("Not a RISC-V ELF file");
+    }
+    entry = eh->e_entry;
+
+    // Loadable segments
+    if(eh->e_phoff + (uint64_t)eh->e_phnum * sizeof(Elf32_Phdr) > buf.size()) {
+        return fail("Truncated program header table");
+    }
+    segments.clear();
+    for(unsigned i = 0; i < eh->e_phnum; i++) {
+        const Elf32_Phdr *ph = (const Elf32_Phdr *)(buf.data() + eh->e_phoff) + i;
+        if(ph->p_type != PT_LOAD || ph->p_memsz == 0) {
+            continue;
+        }
+        if((uint64_t)ph->p_offset + ph->p_filesz > buf.size() || ph->p_filesz > ph->p_memsz) {
+            return fail("Invalid PT_LOAD segment");
+        }
+        segments.push_back({ph->p_paddr, buf.data() + ph->p_offset, ph->p_filesz, ph->p_memsz});
+    }
+
+    // Symbol table (optional, stripped files have none)
+    symbols.clear();
+    if(eh->e_shoff == 0 || eh->e_shoff + (uint64_t)eh->e_shnum * sizeof(Elf32_Shdr) > buf.size()) {
+        return true;
+    }
+    const Elf32_Shdr *sh = (const Elf32_Shdr *)(buf.data() + eh->e_shoff);
+    for(unsigned i = 0; i < eh->e_shnum; i++) {
+        if(sh[i].sh_type != SHT_SYMTAB || sh[i].sh_link >= eh->e_shnum) {
+            continue;
+        }
+        const Elf32_Shdr &strtab = sh[sh[i].sh_link];
+        if((uint64_t)sh[i].sh_offset + sh[i].sh_size > buf.size() || (uint64_t)strtab.sh_offset + strtab.sh_size > buf.size()) {
+            return fail("Invalid symbol table");
+        }
+        const Elf32_Sym *syms = (const Elf32_Sym *)(buf.data() + sh[i].sh_offset);
+        const char *strs = (const char *)(buf.data() + strtab.sh_offset);
+        for(unsigned j = 0; j < sh[i].sh_size / sizeof(Elf32_Sym); j++) {
+            unsigned type = ELF32_ST_TYPE(syms[j].st_info);
+            if(syms[j].st_name == 0 || syms[j].st_name >= strtab.sh_size || syms[j].st_shndx == SHN_UNDEF ||
+                (type != STT_FUNC && type != STT_OBJECT && type != STT_NOTYPE)) {
+                continue;
+            }
+            symbols[strs + syms[j].st_name] = syms[j].st_value;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+
+/*
+    ElfLoader: ELF32 (RISC-V, little-endian) program reader
+    =======================================================
+    Reads the loadable (PT_LOAD) segments and the symbol table of an
+    executable. Segment data points into the file buffer, so the loader must
+    outlive its use.
+*/
+class ElfLoader {
+public:
+    struct Segment_t {
+        uint32_t       addr;        // Physical load address
+        const uint8_t *data;        // File contents (filesz bytes)
+        uint32_t       filesz;
+        uint32_t       memsz;       // filesz..memsz is zero filled (.bss)
+    };
+
+    // Read and validate an ELF file, returns false (with get_error()) on failure
+    bool read(const std::string &filename);
+
+    // Check if a file starts with the ELF magic
+    static bool is_elf(const std::string &filename);
+
+    uint32_t get_entry() { return entry; }
+    const std::vector<Segment_t> &get_segments() { return segments; }
+    const std::map<std::string, uint32_t> &get_symbols() { return symbols; }
+    const std::string &get_error() { return error; }
+
+private:
+    bool fail(const std::string &msg) { error = msg; return false; }
+
+    std::vector<uint8_t> buf;
+    uint32_t entry = 0;
+    std::vector<Segment_t> segments;
+    std::map<std::string, uint32_t> symbols;
+    std::string error;
+};
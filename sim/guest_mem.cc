@@ -0,0 +1,130 @@
+#include "guest_mem.h"
+
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+const size_t GuestMem::PAGE_BYTES;
+
+bool GuestMem::reserve(size_t sz) {
+    release();
+    void *p = mmap(nullptr, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(p == MAP_FAILED) {
+        return false;
+    }
+    base = (uint8_t *)p;
+    size = sz;
+    return true;
+}
+
+void GuestMem::release() {
+    if(base) {
+        munmap(base, size);
+        base = nullptr;
+        size = 0;
+    }
+    files.clear();
+}
+
+bool GuestMem::map_file(const std::string &filename, size_t offset, size_t len) {
+    if(!base || offset % PAGE_BYTES || offset + len > size) {
+        errno = EINVAL;
+        return false;
+    }
+    if(len == 0) {
+        return true;
+    }
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0) {
+        return false;
+    }
+    void *p = mmap(base + offset, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    int err = errno;
+    close(fd);
+    errno = err;
+    if(p == MAP_FAILED) {
+        return false;
+    }
+
+    // The new mapping replaces the ones it overlaps
+    size_t end = offset + len;
+    files.erase(std::remove_if(files.begin(), files.end(), [&](const FileMap_t &f) {
+        return f.offset < end && offset < f.offset + f.len;
+    }), files.end());
+    files.push_back({filename, offset, len});
+    return true;
+}
+
+void GuestMem::clear() {
+    // Private anonymous pages read back as zeros after MADV_DONTNEED
+    if(base) {
+        madvise(base, size, MADV_DONTNEED);
+    }
+}
+
+size_t GuestMem::get_resident() {
+    if(!base) {
+        return 0;
+    }
+    std::vector<unsigned char> vec((size + PAGE_BYTES - 1) / PAGE_BYTES);
+    if(mincore(base, size, vec.data()) != 0) {
+        return 0;
+    }
+    size_t npages = 0;
+    for(unsigned char v: vec) {
+        npages += v & 1;
+    }
+    return npages * PAGE_BYTES;
+}
+
+void GuestMem::save_pages(Pages_t &pages) {
+    // Compare with the cleared memory: the same files mapped over zeros (a
+    // written mapped page differs from its file even when it is all zeros)
+    GuestMem ref;
+    bool ok = files.empty() || ref.reserve(size);
+    for(auto &f: files) {
+        ok = ok && ref.map_file(f.filename, f.offset, f.len);
+    }
+    if(files.empty() || !ok) {
+        save_pages(base, size, pages);
+    } else {
+        save_pages(base, size, pages, ref.base);
+    }
+    if(ok) {
+        return;
+    }
+
+    // A file could not be mapped again (removed, renamed): keep every page of
+    // the mappings
+    for(auto &f: files) {
+        for(size_t offset = f.offset; offset < f.offset + f.len; offset += PAGE_BYTES) {
+            auto it = std::lower_bound(pages.begin(), pages.end(), offset,
+                [](const Page_t &p, size_t off) { return p.offset < off; });
+            if(it == pages.end() || it->offset != offset) {
+                pages.insert(it, {offset, std::vector<uint8_t>(base + offset, base + offset + PAGE_BYTES)});
+            }
+        }
+    }
+}
+
+void GuestMem::save_pages(const void *mem, size_t size, Pages_t &pages, const void *ref) {
+    static const uint8_t zero_page[PAGE_BYTES] = {};
+    pages.clear();
+    for(size_t offset = 0; offset < size; offset += PAGE_BYTES) {
+        const uint8_t *page = (const uint8_t *)mem + offset;
+        const uint8_t *ref_page = ref ? (const uint8_t *)ref + offset : zero_page;
+        size_t len = size - offset < PAGE_BYTES ? size - offset : PAGE_BYTES;
+        if(memcmp(page, ref_page, len) != 0) {
+            pages.push_back({offset, std::vector<uint8_t>(page, page + len)});
+        }
+    }
+}
+
+void GuestMem::load_pages(void *mem, const Pages_t &pages) {
+    for(auto &page: pages) {
+        memcpy((uint8_t *)mem + page.offset, page.data.data(), page.data.size());
+    }
+}
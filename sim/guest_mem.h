@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <string>
+
+/*
+    GuestMem: sparse guest memory
+    =============================
+    Reserves the whole guest memory as anonymous virtual memory without
+    backing it; the host kernel allocates a zeroed page on the first touch.
+    The memory stays flat, so the ISS, the loaders and the DPI memory access
+    it through a plain pointer, while hundreds of MB of guest memory only cost
+    the pages the program touches. Clearing hands the pages back instead of
+    writing zeros.
+
+    Memory images (snapshots, checkpoints) hold the pages that differ from
+    the cleared memory only: non-zero pages, and the written pages of the
+    mapped files (the others read back from the files).
+*/
+class GuestMem {
+public:
+    static const size_t PAGE_BYTES = 4096;
+
+    // Non-zero page of a memory image
+    struct Page_t {
+        size_t               offset;
+        std::vector<uint8_t> data;
+    };
+    typedef std::vector<Page_t> Pages_t;
+
+    GuestMem() {}
+    GuestMem(const GuestMem &) = delete;
+    GuestMem &operator=(const GuestMem &) = delete;
+    ~GuestMem() { release(); }
+
+    // Reserve size bytes (multiple of PAGE_BYTES), returns false on failure
+    bool reserve(size_t size);
+
+    uint32_t *get_words() { return (uint32_t *)base; }
+    size_t get_size() { return size; }
+
+    // Map a host file at offset (page aligned) copy-on-write: the pages are
+    // shared with the page cache until written. Returns false (errno set) on
+    // failure
+    bool map_file(const std::string &filename, size_t offset, size_t len);
+
+    // Zero the memory, dropping the host pages (mapped files read back their
+    // contents)
+    void clear();
+
+    // Host memory backing the guest memory
+    size_t get_resident();
+
+    // Copy the pages that differ from the cleared memory into an image (load
+    // it with load_pages() after clear())
+    void save_pages(Pages_t &pages);
+
+    // Copy the non-zero pages of a memory into an image / an image into a
+    // cleared memory
+    static void save_pages(const void *mem, size_t size, Pages_t &pages, const void *ref = nullptr);
+    static void load_pages(void *mem, const Pages_t &pages);
+
+private:
+    // Mapped file
+    struct FileMap_t {
+        std::string filename;
+        size_t      offset;
+        size_t      len;
+    };
+
+    void release();
+
+    uint8_t *base = nullptr;
+    size_t   size = 0;
+    std::vector<FileMap_t> files;
+};
@@ -0,0 +1,314 @@
+#include "iss.h"
+
+// Instruction fields
+#define OPCODE(i)   ((i) & 0x7f)
+#define RD(i)       (((i) >> 7) & 0x1f)
+#define RS1(i)      (((i) >> 15) & 0x1f)
+#define RS2(i)      (((i) >> 20) & 0x1f)
+#define FUNCT3(i)   (((i) >> 12) & 0x7)
+#define FUNCT7(i)   ((i) >> 25)
+
+// Immediates (sign extended)
+#define IMM_I(i)    ((int32_t)(i) >> 20)
+#define IMM_S(i)    ((((int32_t)(i) >> 20) & ~0x1f) | (((i) >> 7) & 0x1f))
+#define IMM_B(i)    ((((int32_t)(i) >> 19) & ~0xfff) | (((i) << 4) & 0x800) | (((i) >> 20) & 0x7e0) | (((i) >> 7) & 0x1e))
+#define IMM_U(i)    ((i) & 0xfffff000)
+#define IMM_J(i)    ((((int32_t)(i) >> 11) & ~0xfffff) | ((i) & 0xff000) | (((i) >> 9) & 0x800) | (((i) >> 20) & 0x7fe))
+
+// Opcodes
+#define OP_LUI      0x37
+#define OP_AUIPC    0x17
+#define OP_JAL      0x6f
+#define OP_JALR     0x67
+#define OP_BRANCH   0x63
+#define OP_LOAD     0x03
+#define OP_STORE    0x23
+#define OP_IMM      0x13
+#define OP_REG      0x33
+#define OP_FENCE    0x0f
+#define OP_SYSTEM   0x73
+
+#define INSTR_EBREAK 0x00100073
+#define INSTR_WFI    0x10500073
+
+Iss::Iss(uint32_t *mem, uint32_t mem_addr, uint32_t mem_size):
+    mem(mem), mem_addr(mem_addr), mem_size(mem_size) {}
+
+void Iss::set_mmio(uint32_t addr, uint32_t size, MmioHandler *handler) {
+    mmio_addr = addr;
+    mmio_size = size;
+    mmio      = handler;
+}
+
+Iss::MmioHandler *Iss::decode_io(uint32_t word_addr) {
+    for(auto &io: ios) {
+        if(word_addr - io.addr < io.size) {
+            return io.handler;
+        }
+    }
+    return nullptr;
+}
+
+void Iss::reset(uint32_t reset_pc) {
+    pc = reset_pc;
+    for(auto &r: regs) {
+        r = 0;
+    }
+    instret  = 0;
+    halt_req = false;
+    stop_cause = ISS_STOP_NONE;
+}
+
+uint64_t Iss::run(uint64_t ninstrs) {
+    uint64_t n = 0;
+    stop_cause = ISS_STOP_NONE;
+    while(n < ninstrs) {
+        if(!step()) {
+            break;
+        }
+        n++;
+        instret++;
+        if(halt_req) {
+            halt_req = false;
+            stop_cause = ISS_STOP_HALT_REQ;
+            break;
+        }
+    }
+    return n;
+}
+
+bool Iss::load(uint32_t addr, unsigned size, uint32_t &data) {
+    if(addr & (size - 1)) {
+        return false;
+    }
+    uint32_t word_addr = addr & ~0x3;
+    uint32_t word;
+    if(mmio && word_addr - mmio_addr < mmio_size) {
+        word = mmio->mmio_load(word_addr);
+    }
+    else if(word_addr - mem_addr < mem_size) {
+        word = mem[(word_addr - mem_addr) / 4];
+    }
+    else if(MmioHandler *io = decode_io(word_addr)) {
+        word = io->mmio_load(word_addr);
+    }
+    else {
+        return false;
+    }
+    data = word >> ((addr & 0x3) * 8);
+    return true;
+}
+
+bool Iss::store(uint32_t addr, unsigned size, uint32_t data) {
+    if(addr & (size - 1)) {
+        return false;
+    }
+    uint32_t word_addr = addr & ~0x3;
+    unsigned shift = (addr & 0x3) * 8;
+    uint8_t  mask  = ((1 << size) - 1) << (addr & 0x3);
+    uint32_t bits  = size == 4 ? 0xffffffff : (((1u << (size * 8)) - 1) << shift);
+    data <<= shift;
+    commit.mem_addr  = addr;
+    commit.mem_wmask = mask;
+    commit.mem_wdata = data & bits;
+
+    if(mmio && word_addr - mmio_addr < mmio_size) {
+        halt_req |= mmio->mmio_store(word_addr, data & bits, mask);
+    }
+    else if(word_addr - mem_addr < mem_size) {
+        for(auto &rom: roms) {
+            if(word_addr - rom.first < rom.second) {
+                return true;
+            }
+        }
+        uint32_t &word = mem[(word_addr - mem_addr) / 4];
+        word = (word & ~bits) | (data & bits);
+    }
+    else if(MmioHandler *io = decode_io(word_addr)) {
+        halt_req |= io->mmio_store(word_addr, data & bits, mask);
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+bool Iss::step() {
+    uint32_t instr;
+    if(pc & 0x3 || !load(pc, 4, instr)) {
+        stop_cause = ISS_STOP_MEM_FAULT;
+        return false;
+    }
+
+    commit.pc = pc;
+    commit.instr = instr;
+    commit.mem_rmask = 0;
+    commit.mem_wmask = 0;
+
+    uint32_t rs1 = regs[RS1(instr)];
+    uint32_t rs2 = regs[RS2(instr)];
+    uint32_t rd_v = 0;
+    bool     rd_we = true;
+    uint32_t pc_next = pc + 4;
+
+    switch(OPCODE(instr)) {
+        case OP_LUI:
+            rd_v = IMM_U(instr);
+            break;
+
+        case OP_AUIPC:
+            rd_v = pc + IMM_U(instr);
+            break;
+
+        case OP_JAL:
+            rd_v = pc + 4;
+            pc_next = pc + IMM_J(instr);
+            break;
+
+        case OP_JALR:
+            rd_v = pc + 4;
+            pc_next = (rs1 + IMM_I(instr)) & ~0x1;
+            break;
+
+        case OP_BRANCH: {
+            bool taken;
+            switch(FUNCT3(instr)) {
+                case 0x0: taken = rs1 == rs2; break;
+                case 0x1: taken = rs1 != rs2; break;
+                case 0x4: taken = (int32_t)rs1 <  (int32_t)rs2; break;
+                case 0x5: taken = (int32_t)rs1 >= (int32_t)rs2; break;
+                case 0x6: taken = rs1 <  rs2; break;
+                case 0x7: taken = rs1 >= rs2; break;
+                default:
+                    stop_cause = ISS_STOP_ILLEGAL_INSTR;
+                    return false;
+            }
+            if(taken) {
+                pc_next = pc + IMM_B(instr);
+            }
+            rd_we = false;
+            break;
+        }
+
+        case OP_LOAD: {
+            uint32_t addr = rs1 + IMM_I(instr);
+            uint32_t data;
+            unsigned size = 1 << (FUNCT3(instr) & 0x3);
+            if(FUNCT3(instr) == 0x3 || FUNCT3(instr) > 0x5) {
+                stop_cause = ISS_STOP_ILLEGAL_INSTR;
+                return false;
+            }
+            if(!load(addr, size, data)) {
+                stop_cause = ISS_STOP_MEM_FAULT;
+                return false;
+            }
+            commit.mem_addr = addr;
+            commit.mem_rmask = ((1 << size) - 1) << (addr & 0x3);
+            switch(FUNCT3(instr)) {
+                case 0x0: rd_v = (int32_t)(int8_t)data;  break;  // LB
+                case 0x1: rd_v = (int32_t)(int16_t)data; break;  // LH
+                case 0x2: rd_v = data;                   break;  // LW
+                case 0x4: rd_v = (uint8_t)data;          break;  // LBU
+                case 0x5: rd_v = (uint16_t)data;         break;  // LHU
+            }
+            break;
+        }
+
+        case OP_STORE: {
+            if(FUNCT3(instr) > 0x2) {
+                stop_cause = ISS_STOP_ILLEGAL_INSTR;
+                return false;
+            }
+            if(!store(rs1 + IMM_S(instr), 1 << FUNCT3(instr), rs2)) {
+                stop_cause = ISS_STOP_MEM_FAULT;
+                return false;
+            }
+            rd_we = false;
+            break;
+        }
+
+        case OP_IMM: {
+            int32_t imm = IMM_I(instr);
+            unsigned shamt = imm & 0x1f;
+            switch(FUNCT3(instr)) {
+                case 0x0: rd_v = rs1 + imm; break;                                  // ADDI
+                case 0x1: rd_v = rs1 << shamt; break;                               // SLLI
+                case 0x2: rd_v = (int32_t)rs1 < imm; break;                         // SLTI
+                case 0x3: rd_v = rs1 < (uint32_t)imm; break;                        // SLTIU
+                case 0x4: rd_v = rs1 ^ imm; break;                                  // XORI
+                case 0x5: rd_v = (FUNCT7(instr) & 0x20) ? (uint32_t)((int32_t)rs1 >> shamt) : rs1 >> shamt; break;  // SRAI/SRLI
+                case 0x6: rd_v = rs1 | imm; break;                                  // ORI
+                case 0x7: rd_v = rs1 & imm; break;                                  // ANDI
+            }
+            break;
+        }
+
+        case OP_REG:
+            if(FUNCT7(instr) == 0x01) {
+                // RV32M
+                int32_t a = rs1, b = rs2;
+                switch(FUNCT3(instr)) {
+                    case 0x0: rd_v = rs1 * rs2; break;                                          // MUL
+                    case 0x1: rd_v = ((int64_t)a * (int64_t)b) >> 32; break;                    // MULH
+                    case 0x2: rd_v = ((int64_t)a * (int64_t)(uint64_t)rs2) >> 32; break;        // MULHSU
+                    case 0x3: rd_v = ((uint64_t)rs1 * (uint64_t)rs2) >> 32; break;              // MULHU
+                    case 0x4: rd_v = b == 0 ? 0xffffffff : (a == INT32_MIN && b == -1) ? rs1 : (uint32_t)(a / b); break;   // DIV
+                    case 0x5: rd_v = rs2 == 0 ? 0xffffffff : rs1 / rs2; break;                  // DIVU
+                    case 0x6: rd_v = b == 0 ? rs1 : (a == INT32_MIN && b == -1) ? 0 : (uint32_t)(a % b); break;            // REM
+                    case 0x7: rd_v = rs2 == 0 ? rs1 : rs1 % rs2; break;                         // REMU
+                }
+            }
+            else if((FUNCT7(instr) & ~0x20) == 0x00) {
+                bool alt = FUNCT7(instr) & 0x20;
+                switch(FUNCT3(instr)) {
+                    case 0x0: rd_v = alt ? rs1 - rs2 : rs1 + rs2; break;                        // ADD/SUB
+                    case 0x1: rd_v = rs1 << (rs2 & 0x1f); break;                                // SLL
+                    case 0x2: rd_v = (int32_t)rs1 < (int32_t)rs2; break;                        // SLT
+                    case 0x3: rd_v = rs1 < rs2; break;                                          // SLTU
+                    case 0x4: rd_v = rs1 ^ rs2; break;                                          // XOR
+                    case 0x5: rd_v = alt ? (uint32_t)((int32_t)rs1 >> (rs2 & 0x1f)) : rs1 >> (rs2 & 0x1f); break;  // SRA/SRL
+                    case 0x6: rd_v = rs1 | rs2; break;                                          // OR
+                    case 0x7: rd_v = rs1 & rs2; break;                                          // AND
+                }
+                if(alt && FUNCT3(instr) != 0x0 && FUNCT3(instr) != 0x5) {
+                    stop_cause = ISS_STOP_ILLEGAL_INSTR;
+                    return false;
+                }
+            }
+            else {
+                stop_cause = ISS_STOP_ILLEGAL_INSTR;
+                return false;
+            }
+            break;
+
+        case OP_FENCE:
+            // Single hart, no caches: NOP
+            rd_we = false;
+            break;
+
+        case OP_SYSTEM:
+            // Only EBREAK and WFI, executed as NOPs (the WFI handler skips
+            // the sleep cycles)
+            if(instr != INSTR_EBREAK && instr != INSTR_WFI) {
+                stop_cause = ISS_STOP_ILLEGAL_INSTR;
+                return false;
+            }
+            if(instr == INSTR_WFI && wfi) {
+                wfi->wfi();
+            }
+            rd_we = false;
+            break;
+
+        default:
+            stop_cause = ISS_STOP_ILLEGAL_INSTR;
+            return false;
+    }
+
+    commit.rd = rd_we ? RD(instr) : 0;
+    commit.rd_v = rd_v;
+    if(commit.rd != 0) {
+        regs[commit.rd] = rd_v;
+    }
+    pc = pc_next;
+    return true;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+/*
+    Iss: RV32IM functional (instruction set) simulator
+    ==================================================
+    Executes instructions directly on a word array (the verilated dpram memory),
+    so no memory copy is needed when the architectural state is handed off to
+    the RTL model. Accesses to an optional MMIO window (e.g. VDEV) go through a
+    handler instead of memory, as do accesses to the I/O ranges outside the
+    memory (e.g. the CLINT, only decoded when an access misses the memory).
+
+    Like the Orion core, EBREAK is a NOP and WFI returns at once; the WFI
+    handler, if any, accounts for the cycles the core would sleep. The program
+    is stopped through the MMIO handler (VDEV SIMCTRL), an illegal instruction
+    or a bad memory access.
+*/
+
+enum Iss_stop_t {
+    ISS_STOP_NONE,          // Executed the requested number of instructions
+    ISS_STOP_HALT_REQ,      // MMIO handler requested a halt
+    ISS_STOP_ILLEGAL_INSTR, // Illegal/unsupported instruction
+    ISS_STOP_MEM_FAULT      // Out of range or misaligned memory access
+};
+
+// Side effects of an executed instruction (memory fields are byte lane
+// positioned like the core's debug port)
+struct Iss_commit_t {
+    uint32_t pc;
+    uint32_t instr;
+    uint8_t  rd;            // 0: no register write
+    uint32_t rd_v;
+    uint32_t mem_addr;      // Byte address
+    uint8_t  mem_rmask;
+    uint8_t  mem_wmask;
+    uint32_t mem_wdata;
+};
+
+class Iss {
+public:
+    // Handler for accesses to the MMIO window (word aligned addresses)
+    class MmioHandler {
+    public:
+        virtual ~MmioHandler() {}
+
+        // Read a word
+        virtual uint32_t mmio_load(uint32_t addr) = 0;
+
+        // Write the bytes of a word selected by mask, returns true to halt the ISS
+        virtual bool mmio_store(uint32_t addr, uint32_t data, uint8_t mask) = 0;
+    };
+
+    // Handler of the WFI instruction
+    class WfiHandler {
+    public:
+        virtual ~WfiHandler() {}
+
+        // WFI executed: the core would sleep until the timer interrupt is pending
+        virtual void wfi() = 0;
+    };
+
+    Iss(uint32_t *mem, uint32_t mem_addr, uint32_t mem_size);
+
+    // Set the MMIO window (inside or outside the memory range)
+    void set_mmio(uint32_t addr, uint32_t size, MmioHandler *handler);
+
+    // Add an I/O range outside the memory, handled like the MMIO window
+    void add_io(uint32_t addr, uint32_t size, MmioHandler *handler) { ios.push_back({addr, size, handler}); }
+
+    // Set the WFI handler (WFI is a NOP without one)
+    void set_wfi(WfiHandler *handler) { wfi = handler; }
+
+    // Add a read-only memory range: stores to it are dropped
+    void add_rom(uint32_t addr, uint32_t size) { roms.push_back({addr, size}); }
+
+    // Reset the architectural state
+    void reset(uint32_t pc);
+
+    // Execute up to ninstrs instructions, returns the number executed
+    uint64_t run(uint64_t ninstrs);
+
+    // Architectural state
+    uint32_t get_pc() { return pc; }
+    uint32_t get_reg(unsigned i) { return regs[i & 0x1f]; }
+    uint64_t get_instret() { return instret; }
+    void set_pc(uint32_t v) { pc = v; }
+    void set_reg(unsigned i, uint32_t v) { if(i & 0x1f) regs[i & 0x1f] = v; }
+
+    // Side effects of the last executed instruction
+    const Iss_commit_t &get_commit() { return commit; }
+
+    // Why the last run() stopped
+    Iss_stop_t get_stop_cause() { return stop_cause; }
+
+private:
+    // Execute one instruction, returns false if it could not be executed
+    bool step();
+
+    bool load(uint32_t addr, unsigned size, uint32_t &data);
+    bool store(uint32_t addr, unsigned size, uint32_t data);
+
+    // I/O range handler of a word address outside the memory, nullptr if none
+    MmioHandler *decode_io(uint32_t word_addr);
+
+    uint32_t *mem;
+    uint32_t mem_addr;
+    uint32_t mem_size;
+
+    uint32_t     mmio_addr = 0;
+    uint32_t     mmio_size = 0;
+    MmioHandler *mmio      = nullptr;
+
+    struct IoRange_t {
+        uint32_t     addr;
+        uint32_t     size;
+        MmioHandler *handler;
+    };
+    std::vector<IoRange_t> ios;
+
+    WfiHandler *wfi = nullptr;
+
+    std::vector<std::pair<uint32_t, uint32_t>> roms;    // (addr, size)
+
+    uint32_t pc = 0;
+    uint32_t regs[32] = {};
+    uint64_t instret = 0;
+
+    Iss_commit_t commit = {};
+
+    bool       halt_req   = false;
+    Iss_stop_t stop_cause = ISS_STOP_NONE;
+};
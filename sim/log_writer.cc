@@ -0,0 +1,271 @@
+#include "log_writer.h"
+
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <atomic>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Open writers, finished by the crash handler
+static std::atomic<LogWriter *> open_writers[LogWriter::MAX_WRITERS];
+
+// Set once other threads write the open writers
+static std::atomic<bool> writers_threaded(false);
+
+static bool ends_with(const std::string &str, const std::string &suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool parse_flush_policy(const std::string &str, FlushPolicy_t &policy) {
+    if(str == "line") {
+        policy = FLUSH_LINE;
+    } else if(str == "interval") {
+        policy = FLUSH_INTERVAL;
+    } else if(str == "exit") {
+        policy = FLUSH_EXIT;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool LogWriter::open(const std::string &filename, FlushPolicy_t policy) {
+    close();
+    codec = CODEC_NONE;
+    if(ends_with(filename, ".gz")) {
+        codec = CODEC_GZIP;
+    } else if(ends_with(filename, ".zst")) {
+#ifdef SIM_ZSTD
+        codec = CODEC_ZSTD;
+#else
+        fprintf(stderr, "Error: %s: zstd output needs a zstd build (make sim ZSTD=1)\n", filename.c_str());
+        return false;
+#endif
+    }
+
+    fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0) {
+        return false;
+    }
+
+    if(codec == CODEC_GZIP) {
+        memset(&zs, 0, sizeof(zs));
+        // windowBits 15 + 16: gzip header and trailer
+        if(deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        out.resize(deflateBound(&zs, BUF_SIZE));
+    }
+#ifdef SIM_ZSTD
+    else if(codec == CODEC_ZSTD) {
+        zcs = ZSTD_createCStream();
+        if(!zcs || ZSTD_isError(ZSTD_initCStream(zcs, 3))) {
+            ZSTD_freeCStream(zcs);
+            zcs = nullptr;
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        out.resize(ZSTD_CStreamOutSize());
+    }
+#endif
+
+    this->filename = filename;
+    buf.resize(BUF_SIZE);
+    used = 0;
+    error = false;
+    timer = FlushTimer();
+    timer.set_policy(policy);
+
+    // Register with the crash handler
+    for(int i = 0; i < MAX_WRITERS; i++) {
+        LogWriter *expected = nullptr;
+        if(open_writers[i].compare_exchange_strong(expected, this)) {
+            slot = i;
+            break;
+        }
+    }
+    return true;
+}
+
+void LogWriter::close() {
+    if(fd < 0) {
+        return;
+    }
+    if(slot >= 0) {
+        open_writers[slot].store(nullptr);
+        slot = -1;
+    }
+    drain(MODE_FINISH);
+    if(codec == CODEC_GZIP) {
+        deflateEnd(&zs);
+    }
+#ifdef SIM_ZSTD
+    if(codec == CODEC_ZSTD) {
+        ZSTD_freeCStream(zcs);
+        zcs = nullptr;
+    }
+#endif
+    ::close(fd);
+    fd = -1;
+    if(error) {
+        fprintf(stderr, "Error: Could not write %s: %s\n", filename.c_str(), strerror(errno));
+    }
+}
+
+void LogWriter::printf(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    size_t room = BUF_SIZE - used;
+    int n = vsnprintf(buf.data() + used, room, fmt, args);
+    va_end(args);
+    if(n < 0) {
+        return;
+    }
+    if((size_t)n >= room) {
+        // Did not fit: make room and format again
+        drain(MODE_CONTINUE);
+        va_start(args, fmt);
+        n = vsnprintf(buf.data(), BUF_SIZE, fmt, args);
+        va_end(args);
+        n = std::min(n, (int)BUF_SIZE - 1);
+    }
+    used += n;
+}
+
+void LogWriter::flush() {
+    if(fd >= 0) {
+        drain(MODE_FLUSH);
+    }
+}
+
+void LogWriter::write_large(const void *data, size_t len) {
+    drain(MODE_CONTINUE);
+    if(len > BUF_SIZE) {
+        compress(data, len, MODE_CONTINUE);
+        return;
+    }
+    memcpy(buf.data(), data, len);
+    used = len;
+}
+
+bool LogWriter::drain(Mode_t mode) {
+    bool ok = compress(buf.data(), used, mode);
+    used = 0;
+    return ok;
+}
+
+bool LogWriter::compress(const void *data, size_t len, Mode_t mode) {
+    if(codec == CODEC_NONE) {
+        return len == 0 || write_fd(data, len);
+    }
+
+    if(codec == CODEC_GZIP) {
+        int flush = mode == MODE_FINISH ? Z_FINISH : mode == MODE_FLUSH ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+        zs.next_in = (Bytef *)data;
+        zs.avail_in = len;
+        do {
+            zs.next_out = (Bytef *)out.data();
+            zs.avail_out = out.size();
+            int ret = deflate(&zs, flush);
+            if(ret == Z_STREAM_ERROR) {
+                error = true;
+                return false;
+            }
+            size_t n = out.size() - zs.avail_out;
+            if(n > 0 && !write_fd(out.data(), n)) {
+                return false;
+            }
+            // Done when the input is consumed and the output did not fill up
+            // (a sync flush or the stream end may need another round)
+        } while(zs.avail_in > 0 || zs.avail_out == 0);
+        return true;
+    }
+
+#ifdef SIM_ZSTD
+    ZSTD_EndDirective end = mode == MODE_FINISH ? ZSTD_e_end : mode == MODE_FLUSH ? ZSTD_e_flush : ZSTD_e_continue;
+    ZSTD_inBuffer in = {data, len, 0};
+    while(1) {
+        ZSTD_outBuffer zout = {out.data(), out.size(), 0};
+        size_t remaining = ZSTD_compressStream2(zcs, &zout, &in, end);
+        if(ZSTD_isError(remaining)) {
+            error = true;
+            return false;
+        }
+        if(zout.pos > 0 && !write_fd(out.data(), zout.pos)) {
+            return false;
+        }
+        // ZSTD_e_continue: done once the input is consumed, flush/end: once
+        // nothing is left in the internal buffers
+        if(end == ZSTD_e_continue ? in.pos == in.size : remaining == 0) {
+            break;
+        }
+    }
+#endif
+    return true;
+}
+
+bool LogWriter::write_fd(const void *data, size_t len) {
+    if(error) {
+        return false;
+    }
+    const char *p = (const char *)data;
+    while(len > 0) {
+        ssize_t n = ::write(fd, p, len);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            error = true;
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+void LogWriter::emergency_flush() {
+    // Finish the stream so that the file is complete up to here (deflate
+    // does not allocate after deflateInit2)
+    drain(MODE_FINISH);
+    ::close(fd);
+    fd = -1;
+}
+
+void LogWriter::on_signal(int sig) {
+    // Another thread may be in the middle of a write: leave the files as
+    // they are
+    if(!writers_threaded.load()) {
+        for(int i = 0; i < MAX_WRITERS; i++) {
+            LogWriter *w = open_writers[i].exchange(nullptr);
+            if(w && w->codec != CODEC_ZSTD) {
+                w->emergency_flush();
+            }
+        }
+    }
+    // The handler was reset to the default action (SA_RESETHAND): deliver
+    // the signal again once this handler returns
+    raise(sig);
+}
+
+void LogWriter::set_threaded() {
+    writers_threaded = true;
+}
+
+void LogWriter::install_crash_handlers() {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sa.sa_flags = SA_RESETHAND;
+    sigemptyset(&sa.sa_mask);
+    for(int sig: {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT}) {
+        sigaction(sig, &sa, nullptr);
+    }
+}
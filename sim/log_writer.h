@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include <zlib.h>
+#ifdef SIM_ZSTD
+#include <zstd.h>
+#endif
+
+/*
+    LogWriter: buffered, compressed output file
+    ===========================================
+    Output file of the simulation log and the VCD trace. The data is
+    collected in a large buffer and compressed on the fly when the file name
+    ends in .gz (zlib) or .zst (zstd, ZSTD=1 builds), so that a long run does
+    not write a syscall per cycle nor fill the disk.
+
+    When the buffered data reaches the file is set by the flush policy
+    (--flush-policy), checked at the end of each record (a log line, a trace
+    cycle):
+        line:       flush every record (tail -f, slowest)
+        interval:   flush at most once per FLUSH_INTERVAL_MS
+        exit:       flush when the buffer is full and at close
+
+    A compressed flush ends a decodable block (gzip sync flush / zstd flush),
+    so the file can be read up to the last flush while the run goes on.
+
+    Interrupt signals (SIGINT, SIGTERM, SIGHUP) stop the run, which then
+    closes its writers as usual (orionsim's signal thread).
+    install_crash_handlers() finishes the open writers when the process
+    crashes (SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT), before the signal
+    takes its default action. The handler runs on the crashing thread, so it
+    only covers the single-threaded path: it does nothing once
+    set_threaded() said that other threads write the writers (commit stream
+    consumers), and it skips zstd writers (the compressor may allocate).
+    Data still buffered by their users (VCD/FST internal buffers, stdout) is
+    lost.
+*/
+
+enum FlushPolicy_t {
+    FLUSH_LINE,
+    FLUSH_INTERVAL,
+    FLUSH_EXIT
+};
+
+// Parse a --flush-policy value, returns false if it is unknown
+bool parse_flush_policy(const std::string &str, FlushPolicy_t &policy);
+
+// Decides at the end of each record whether the output should be flushed
+class FlushTimer {
+public:
+    enum {
+        FLUSH_INTERVAL_MS = 1000,
+        CHECK_RECORDS     = 1024    // Records between clock reads (interval)
+    };
+
+    void set_policy(FlushPolicy_t p) { policy = p; }
+    FlushPolicy_t get_policy() { return policy; }
+
+    // A record ended, returns true if the output should be flushed now
+    inline bool record_done() {
+        if(policy == FLUSH_LINE) {
+            return true;
+        }
+        if(policy == FLUSH_EXIT || ++nrecords < CHECK_RECORDS) {
+            return false;
+        }
+        nrecords = 0;
+        auto now = std::chrono::steady_clock::now();
+        if(now - last_flush < std::chrono::milliseconds(FLUSH_INTERVAL_MS)) {
+            return false;
+        }
+        last_flush = now;
+        return true;
+    }
+
+private:
+    FlushPolicy_t policy = FLUSH_INTERVAL;
+    unsigned nrecords = 0;
+    std::chrono::steady_clock::time_point last_flush = std::chrono::steady_clock::now();
+};
+
+class LogWriter {
+public:
+    enum {
+        BUF_SIZE     = 1 << 20,     // Uncompressed data buffered before a write
+        MAX_WRITERS  = 16           // Open writers flushed by the crash handler
+    };
+
+    enum Codec_t {
+        CODEC_NONE,
+        CODEC_GZIP,
+        CODEC_ZSTD
+    };
+
+    ~LogWriter() { close(); }
+
+    // Create filename, compressed according to its extension (.gz, .zst)
+    bool open(const std::string &filename, FlushPolicy_t policy = FLUSH_INTERVAL);
+
+    // Flush, finish the compressed stream and close the file
+    void close();
+
+    bool is_open() { return fd >= 0; }
+    Codec_t get_codec() { return codec; }
+
+    inline void write(const void *data, size_t len) {
+        if(len > BUF_SIZE - used) {
+            write_large(data, len);
+            return;
+        }
+        memcpy(buf.data() + used, data, len);
+        used += len;
+    }
+
+    void printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    // A record ended: flush if the policy says so
+    inline void record_done() {
+        if(timer.record_done()) {
+            flush();
+        }
+    }
+
+    // Write the buffered data (ending a compressed block)
+    void flush();
+
+    // Finish the open writers on fatal signals (single-threaded runs)
+    static void install_crash_handlers();
+
+    // Other threads write the open writers from now on: the crash handler
+    // leaves them alone
+    static void set_threaded();
+
+private:
+    enum Mode_t {
+        MODE_CONTINUE,  // Compress, output what the compressor produced
+        MODE_FLUSH,     // Compress and end a decodable block
+        MODE_FINISH     // Compress and end the stream
+    };
+
+    void write_large(const void *data, size_t len);
+
+    // Pass the buffered data through the compressor and write the output
+    bool drain(Mode_t mode);
+    bool compress(const void *data, size_t len, Mode_t mode);
+    bool write_fd(const void *data, size_t len);
+
+    // Called by the crash handler (no allocation)
+    void emergency_flush();
+    static void on_signal(int sig);
+
+    int      fd = -1;
+    Codec_t  codec = CODEC_NONE;
+    bool     error = false;
+    std::string filename;
+
+    std::vector<char> buf;      // Uncompressed data
+    size_t   used = 0;
+    std::vector<char> out;      // Compressed data
+
+    z_stream zs;
+#ifdef SIM_ZSTD
+    ZSTD_CStream *zcs = nullptr;
+#endif
+
+    FlushTimer timer;
+    int slot = -1;              // Index in the crash handler's list
+};
@@ -0,0 +1,39 @@
+#include "mem_model.h"
+
+#ifdef SIM_MEM_DPI
+#include "Vorion_soc__Dpi.h"
+
+// DPI imports of rtl/soc/dpi_mem.sv. The model handle is the MemModel pointer
+// (0 until the simulator sets it: dpram timing).
+
+void dpi_mem_tick(long long model) {
+    if(model) {
+        ((MemModel *)model)->tick();
+    }
+}
+
+int dpi_mem_cycle(long long model, int port, svBit valid, svBit we) {
+    if(!model) {
+        return valid ? MemModel::MEM_ACCEPT | MemModel::MEM_RESP : 0;
+    }
+    return ((MemModel *)model)->cycle(port, valid, we);
+}
+
+void dpi_mem_reset(long long model) {
+    if(model) {
+        ((MemModel *)model)->reset();
+    }
+}
+
+#ifdef SIM_MEM_SPARSE
+int dpi_mem_read(long long model, int index) {
+    return model ? ((MemModel *)model)->read(index) : 0;
+}
+
+void dpi_mem_write(long long model, int index, int data, char mask) {
+    if(model) {
+        ((MemModel *)model)->write(index, data, mask);
+    }
+}
+#endif
+#endif
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+/*
+    MemModel: timing model of the DPI memory (rtl/soc/dpi_mem.sv)
+    ==============================================================
+    Decides, at every clock edge, whether the imem/dmem port accepts the
+    request it is presented and when the response is returned:
+
+    - Latency: cycles from the accepting edge to the response (1 is the
+      timing of dpram), separately for reads and writes.
+    - Jitter: a uniformly distributed 0..jitter cycles added to each access.
+    - Bandwidth: bytes per cycle shared by both ports (0: unlimited); an
+      access moves one 4 byte word. The dmem port is served first.
+
+    Each port holds one request at a time, like the core expects.
+
+    In sparse memory builds the model also serves the data, from a word array
+    owned by the simulator (GuestMem).
+*/
+
+struct MemTiming_t {
+    unsigned rlat   = 1;        // Read latency (cycles)
+    unsigned wlat   = 1;        // Write latency (cycles)
+    unsigned jitter = 0;        // Maximum random extra latency (cycles)
+};
+
+class MemModel {
+public:
+    enum Port_t {
+        PORT_IMEM,
+        PORT_DMEM,
+        NPORTS
+    };
+
+    // dpi_mem_cycle() result bits
+    enum {
+        MEM_ACCEPT  = 1 << 0,   // Access the memory at this edge
+        MEM_RESP    = 1 << 1    // Response valid in the next cycle
+    };
+
+    void set_timing(unsigned port, const MemTiming_t &t) { timing[port] = t; }
+    void set_bandwidth(unsigned bytes_per_cycle) { bw = bytes_per_cycle; }
+    void set_seed(uint64_t s) { seed = s ? s : 1; st.rng = seed; }
+    void set_store(uint32_t *words) { store = words; }
+
+    // Read-only word ranges of the storage: writes are dropped and counted
+    void add_rom(uint32_t index, uint32_t nwords) { roms.push_back({index, nwords}); }
+    void clear_roms() { roms.clear(); }
+    uint64_t get_rom_writes() { return rom_writes; }
+
+    // Storage access of an accepted request (word index)
+    inline uint32_t read(uint32_t index) { return store[index]; }
+    inline void write(uint32_t index, uint32_t data, uint8_t mask) {
+        for(auto &rom: roms) {
+            if(index - rom.first < rom.second) {
+                rom_writes++;
+                return;
+            }
+        }
+        uint32_t bmask = 0;
+        for(unsigned i = 0; i < WORD_BYTES; i++) {
+            if(mask & (1 << i)) {
+                bmask |= 0xffu << (i * 8);
+            }
+        }
+        store[index] = (store[index] & ~bmask) | (data & bmask);
+    }
+
+    // Drop the requests in flight (SoC reset)
+    void reset() {
+        for(auto &p: st.ports) {
+            p.pending = false;
+            p.remaining = 0;
+        }
+        st.credits = 0;
+    }
+
+    // Start of a clock edge
+    inline void tick() {
+        if(bw) {
+            // Unused bandwidth is not saved up for later cycles
+            unsigned max_credits = bw > WORD_BYTES ? bw : WORD_BYTES;
+            st.credits += bw;
+            if(st.credits > max_credits) {
+                st.credits = max_credits;
+            }
+        }
+    }
+
+    // Clock edge of a port: the request presented during the cycle that ends
+    inline int cycle(unsigned port, bool valid, bool we) {
+        PortState_t &p = st.ports[port];
+
+        // The response was valid during the cycle that ends, the port is free
+        if(p.pending) {
+            if(p.remaining == 0) {
+                p.pending = false;
+            }
+            else {
+                p.remaining--;
+                p.nwait++;
+            }
+        }
+
+        int rv = 0;
+        if(!p.pending && valid && (!bw || st.credits >= WORD_BYTES)) {
+            const MemTiming_t &t = timing[port];
+            unsigned lat = we ? t.wlat : t.rlat;
+            if(t.jitter) {
+                lat += next_rand() % (t.jitter + 1);
+            }
+            p.pending = true;
+            p.remaining = lat > 0 ? lat - 1 : 0;
+            p.naccesses++;
+            p.nlat += p.remaining + 1;
+            if(bw) {
+                st.credits -= WORD_BYTES;
+            }
+            rv |= MEM_ACCEPT;
+        }
+        else if(!p.pending && valid) {
+            p.nwait++;
+        }
+        if(p.pending && p.remaining == 0) {
+            rv |= MEM_RESP;
+        }
+        return rv;
+    }
+
+    // Clear the statistics and restart the jitter sequence (next program of
+    // a batch, so that each one is timed as if it ran alone)
+    void reset_stats() {
+        for(auto &p: st.ports) {
+            p.naccesses = 0;
+            p.nlat = 0;
+            p.nwait = 0;
+        }
+        rom_writes = 0;
+        st.rng = seed;
+    }
+
+    // Statistics
+    uint64_t get_accesses(unsigned port) { return st.ports[port].naccesses; }
+    uint64_t get_wait_cycles(unsigned port) { return st.ports[port].nwait; }
+    double get_avg_latency(unsigned port) {
+        return st.ports[port].naccesses ? (double)st.ports[port].nlat / st.ports[port].naccesses : 0.0;
+    }
+
+    // Save/restore the requests in flight (checkpoints)
+    template <class T> void save(T &os) { os.write(&st, sizeof(st)); }
+    template <class T> void restore(T &is) { is.read(&st, sizeof(st)); }
+
+private:
+    static const unsigned WORD_BYTES = 4;
+
+    inline uint64_t next_rand() {
+        // xorshift64
+        st.rng ^= st.rng << 13;
+        st.rng ^= st.rng >> 7;
+        st.rng ^= st.rng << 17;
+        return st.rng;
+    }
+
+    struct PortState_t {
+        bool     pending   = false;
+        unsigned remaining = 0;     // Cycles left before the response
+        uint64_t naccesses = 0;
+        uint64_t nlat      = 0;     // Sum of the access latencies
+        uint64_t nwait     = 0;     // Edges a request waited (busy port or no bandwidth)
+    };
+
+    MemTiming_t timing[NPORTS];
+    unsigned    bw = 0;
+    uint64_t    seed = 1;
+    uint32_t   *store = nullptr;
+
+    std::vector<std::pair<uint32_t, uint32_t>> roms;    // (word index, words)
+    uint64_t rom_writes = 0;
+
+    struct {
+        PortState_t ports[NPORTS];
+        unsigned    credits = 0;
+        uint64_t    rng     = 1;
+    } st;
+};
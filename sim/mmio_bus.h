@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+    MmioBus: memory-mapped devices of the simulator
+    ===============================================
+    A device implements MmioDevice and is registered on a word aligned address
+    range. The simulator decodes the accesses on the dmem port against the bus
+    and calls the read/write callbacks of the device they fall into (offsets
+    are relative to the range, word granularity). Devices have no per-cycle
+    hook: while the core does not access them they cost nothing, and any other
+    access costs one check against the bus window (the range spanning all the
+    devices).
+
+    The SoC decodes every address to the memory, so the device ranges are
+    carved out of the RAM: a load from a device reads the word the simulator
+    places in the memory right before the clock edge, a store also lands in the
+    memory (and is ignored there). As a load held off by the DPI memory is
+    presented again, and a younger load may be squashed, read() must not have
+    side effects. write() is called once per store, when the store retires
+    (before the edge it leaves the memory stage), so a store that does not
+    retire has no effect on the devices.
+*/
+class MmioDevice {
+public:
+    virtual ~MmioDevice() {}
+
+    // Read the word at offset
+    virtual uint32_t read(uint32_t offset) = 0;
+
+    // Write the bytes of the word at offset selected by mask
+    virtual void write(uint32_t offset, uint32_t data, uint8_t mask) = 0;
+
+    // Clear the device state (another program is loaded)
+    virtual void reset() {}
+
+    // Plain data state saved in checkpoints (none by default)
+    virtual void *get_state() { return nullptr; }
+    virtual size_t get_state_size() { return 0; }
+};
+
+class MmioBus {
+public:
+    struct Range_t {
+        std::string name;
+        uint32_t    addr;
+        uint32_t    size;
+        MmioDevice *dev;
+    };
+
+    // Register a device (not owned), returns false if the range is not word
+    // aligned or overlaps a registered one
+    bool add(const std::string &name, uint32_t addr, uint32_t size, MmioDevice *dev) {
+        if((addr | size) & 0x3 || size == 0 || addr + size < addr) {
+            return false;
+        }
+        for(auto &r: ranges) {
+            if(addr < r.addr + r.size && r.addr < addr + size) {
+                return false;
+            }
+        }
+        ranges.push_back({name, addr, size, dev});
+        update_window();
+        return true;
+    }
+
+    void remove(MmioDevice *dev) {
+        for(auto it = ranges.begin(); it != ranges.end(); ) {
+            it = it->dev == dev ? ranges.erase(it) : it + 1;
+        }
+        update_window();
+    }
+
+    bool empty() { return ranges.empty(); }
+    std::vector<Range_t> &get_ranges() { return ranges; }
+
+    // Range spanning all the devices
+    uint32_t get_addr() { return win_addr; }
+    uint32_t get_size() { return win_size; }
+
+    // The address may belong to a device
+    inline bool in_window(uint32_t addr) { return addr - win_addr < win_size; }
+
+    // Device range of an address (nullptr if none)
+    inline Range_t *decode(uint32_t addr) {
+        for(auto &r: ranges) {
+            if(addr - r.addr < r.size) {
+                return &r;
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    void update_window() {
+        win_addr = 0;
+        win_size = 0;
+        if(ranges.empty()) {
+            return;
+        }
+        uint32_t lo = UINT32_MAX;
+        uint32_t hi = 0;
+        for(auto &r: ranges) {
+            lo = r.addr < lo ? r.addr : lo;
+            hi = r.addr + r.size - 1 > hi ? r.addr + r.size - 1 : hi;
+        }
+        win_addr = lo;
+        win_size = hi - lo + 1;
+    }
+
+    std::vector<Range_t> ranges;
+    uint32_t win_addr = 0;
+    uint32_t win_size = 0;
+};
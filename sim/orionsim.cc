@@ -3,14 +3,52 @@
 #include <string>
 #include <vector>
 #include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include <csignal>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
 
 #include "argparse.h"
 #include "testbench.h"
+#include "iss.h"
+#include "bbv.h"
+#include "bin_log.h"
+#include "commit_stream.h"
+#include "elf_loader.h"
+#include "mem_model.h"
+#include "guest_mem.h"
+#include "console.h"
+#include "mmio_bus.h"
+#include "vdev.h"
+#include "blkdev.h"
+#include "poll_warp.h"
+
+#ifdef SIM_SAVABLE
+#include <verilated_save.h>
+#endif
 
 #include "Vorion_soc_headers.h"
 
 #define SIM_MAX_CYCLES 10000000
 
+// Cycles simulated between checks for an interrupt signal
+#define SIM_STOP_POLL_CYCLES (1 << 16)
+
+// Number of threads the model was verilated with (set by the Makefile)
+#ifndef SIM_THREADS
+#define SIM_THREADS 1
+#endif
+
 // Get/Set/Clr bits in a word
 #define BIT_GET(x, n)           ((x) & (1 << (n)))
 #define BIT_SET(x, n, v)        ((v) ? ((x) | (1 << (n))) : ((x) & ~(1 << (n))))
@@ -20,65 +58,36 @@
 #define BITS_GET(x, n, m)       ((GET_MASK(n, m) & (x)) >> (m))
 #define BITS_SET(x, n, m, v)    (GET_MASK(n, m) & ((v) << (m)) | ((x) & ~GET_MASK(n, m)))
 
+// Stringify a macro value
+#define STRINGIFY_(x)           #x
+#define STRINGIFY(x)            STRINGIFY_(x)
+
 #define MEM_ADDR 0x00010000
+#ifdef SIM_MEM_SIZE
+#define MEM_SIZE SIM_MEM_SIZE   // Set by the Makefile (MEM_SIZE)
+#else
 #define MEM_SIZE (64*1024)  // 64KB
+#endif
 
-/*
-    VDEV (Virtual Devices)
-    ======================
-    Set of 8 registers to interact with the simulator
-
-    -------+-----------+-------------------------------------------------
-    Offset | Name      | Description
-    -------+-----------+-------------------------------------------------
-    0x00   | CONSOLE   | Console register (console input/output) 
-    0x04   | reserved  | --
-    0x08   | CYCLE     | CYCLE register low-word  (64-bit cycle counter)
-    0x0C   | CYCLE_HI  | CYCLE high-word
-    0x10   | INSTRET   | INSTRET low-word (64-bit instruction retired counter)
-    0x14   | INSTRET_HI| INSTRET high-word
-    0x18   | reserved  | --
-    0x1C   | SIMCTRL   | Simulation control register
-    -------+-----------+-------------------------------------------------
-
-    Register Description
-    =======================
-    0x00: CONSOLE
-        CONSOLE[7:0]:   Tx data
-        CONSOLE[15:8]:  Rx data
-        CONSOLE[16]:    Tx valid
-        CONSOLE[17]:    Rx valid
-
-    0x08: CYCLE
-        CYCLE[31:0]:    Low word of cycle counter
-
-    0x0C: CYCLE_HI
-        CYCLE_HI[31:0]: High word of cycle counter
-
-    0x10: INSTRET
-        INSTRET[31:0]:  Low word of instruction retired counter
-
-    0x14: INSTRET_HI
-        INSTRET_HI[31:0]: High word of instruction retired counter
-
-    0x1C: SIMCTRL
-        SIMCTRL[7:0]:   Return code
-        SIMCTRL[8]:     Finish request
-*/
-
+// VDEV registers (vdev.h) at the top of the RAM
 #define VDEV_ADDR               MEM_ADDR + MEM_SIZE - 0x20
 #define VDEV_SIZE               0x20
 
-#define VDEV_CONSOLE_ADDR       VDEV_ADDR + 0x00 // Console register
-#define VDEV_CYCLE_ADDR         VDEV_ADDR + 0x08 // CYCLE register low-word
-#define VDEV_CYCLE_ADDR_HI      VDEV_ADDR + 0x0C // CYCLE register high-word
-#define VDEV_INSTRET_ADDR       VDEV_ADDR + 0x10 // INSTRET register low-word
-#define VDEV_INSTRET_ADDR_HI    VDEV_ADDR + 0x14 // INSTRET register high-word
-#define VDEV_SIMCTRL_ADDR       VDEV_ADDR + 0x1C // SIMCTRL register
+// Block device registers (blkdev.h) below VDEV, with --blk only
+#define BLKDEV_ADDR             VDEV_ADDR - 0x20
+#define BLKDEV_SIZE             0x20
+
+// CLINT timer registers (rtl/soc/clint.sv), outside the RAM
+#define CLINT_ADDR              0x02000000
+#define CLINT_SIZE              0x10000
 
 
 #define RESET_CYCLES 2
 
+// Checkpoint file header
+#define CKPT_MAGIC   "ORIONSIM-CKPT"
+#define CKPT_VERSION 3
+
 // Logging //////////
 enum verbosity_t {ALL=3, DEFAULT=2, ERRORS=1, NONE=0};
 verbosity_t verbosity = DEFAULT;
@@ -120,16 +129,185 @@ std::string get_masked_hexstr(uint32_t data, uint8_t mask) {
     return std::string(buf);
 }
 
+// Text simulation log (default or spike format), a consumer of the commit
+// stream
+class TextLog: public CommitConsumer {
+public:
+    TextLog(LogWriter *log_w, bool spike): log_w(log_w), spike(spike) {}
+
+    void consume(const Commit_t *c, size_t n) override {
+        for(size_t i = 0; i < n; i++) {
+            write(c[i]);
+        }
+    }
+
+private:
+    void write(const Commit_t &c) {
+        if (spike) {
+            if(!c.valid) {
+                return; // skip bubbles
+            }
+            /*
+            Spike format:
+                default:    core  {core_id}: <priv> <pc> (<instr>)
+                reg update: core  {core_id}: <priv> <pc> (<instr>) <rd> <new_value>
+                store;      core  {core_id}: <priv> <pc> (<instr>) mem <store_target_address> <data_to_store>
+                load;       core  {core_id}: <priv> <pc> (<instr>) rd <loaded_data> mem <load_target_address>
+            */
+            log_w->printf("core   0: 3 0x%08x (0x%08x)", c.pc, c.instr);
+            if(c.mem_rmask) {
+                // rd <loaded_data> mem <load_target_address>
+                log_w->printf(" x%-2d 0x%08x mem 0x%08x", c.rd_s, c.mem_rdata, c.mem_addr);
+            }
+            else if(c.mem_wmask) {
+                // mem <store_target_address> <data_to_store>
+                log_w->printf(" mem 0x%08x 0x%s", c.mem_addr, get_masked_hexstr(c.mem_wdata, c.mem_wmask).c_str());
+            }
+            else if(c.rd_we && c.rd_s != 0) {
+                log_w->printf(" x%-2d 0x%08x", c.rd_s, c.rd_v);
+            } 
+            
+        } else {
+            log_w->printf("[%8lu] %s ", c.cycle, c.valid ? "       " : "INVALID");
+            log_w->printf("PC: 0x%08x, Instr: 0x%08x, ", c.pc, c.instr);
+            log_w->printf("rd: (x%-2d: 0x%08x, we: %d), ", c.rd_s, c.rd_v, c.rd_we);
+            log_w->printf("rs1: (x%-2d: 0x%08x), ", c.rs1_s, c.rs1_v);
+            log_w->printf("rs2: (x%-2d: 0x%08x) ", c.rs2_s, c.rs2_v);
+        }
+        log_w->printf("\n");
+        log_w->record_done();
+    }
+
+    LogWriter *log_w;
+    bool       spike;
+};
+
 enum Term_cause_t {
     TERM_CAUSE_UNKNOWN,     // Unknown termination cause
     TERM_CAUSE_FINISH,      // $finish called from RTL
     TERM_CAUSE_MAX_CYCLES,  // Reached maximum cycles
-    TERM_CAUSE_TERM_REQ     // Termination request from software
+    TERM_CAUSE_TERM_REQ,    // Termination request from software
+    TERM_CAUSE_MAX_INSTRET, // Reached maximum retired instructions
+    TERM_CAUSE_COSIM,       // Co-simulation mismatch
+    TERM_CAUSE_CHECKPOINT,  // Could not save the checkpoint
+    TERM_CAUSE_SIGNAL       // Interrupted by SIGINT, SIGTERM or SIGHUP
+};
+
+// Interrupt signal taken by the signal thread (0: none): the simulations stop
+// at their next check and shut down as usual
+static std::atomic<int> stop_signal(0);
+
+// Devices and the CLINT as seen by the co-simulation reference model: loads
+// return the data the core loaded (counters differ between the models), stores
+// are ignored
+class CosimMmio: public Iss::MmioHandler {
+public:
+    CosimMmio(const uint32_t *mem_addr, const uint32_t *mem_rdata): mem_addr(mem_addr), mem_rdata(mem_rdata) {}
+
+    uint32_t mmio_load(uint32_t addr) override {
+        return *mem_rdata << ((*mem_addr & 0x3) * 8);
+    }
+
+    bool mmio_store(uint32_t addr, uint32_t data, uint8_t mask) override {
+        return false;
+    }
+
+private:
+    const uint32_t *mem_addr;
+    const uint32_t *mem_rdata;
+};
+
+// CLINT timer as seen by the fast-forward ISS: each instruction counts as one
+// cycle (like the VDEV counters) and WFI skips the cycles the core would sleep,
+// mtime follows both. The timer is handed off to the RTL CLINT with the
+// architectural state.
+class IssClint: public Iss::MmioHandler, public Iss::WfiHandler {
+public:
+    // Register offsets
+    enum {
+        MTIMECMP_LO = 0x4000,
+        MTIMECMP_HI = 0x4004,
+        MTIME_LO    = 0xBFF8,
+        MTIME_HI    = 0xBFFC
+    };
+
+    IssClint(Iss &iss): iss(iss) {}
+
+    // Cycles since the ISS started (instructions and sleep)
+    uint64_t get_cycles() { return iss.get_instret() + sleep_cycles; }
+    uint64_t get_mtime() { return get_cycles() + mtime_offset; }
+    uint64_t get_mtimecmp() { return mtimecmp; }
+
+    uint32_t mmio_load(uint32_t addr) override {
+        switch(addr - CLINT_ADDR) {
+            case MTIMECMP_LO:   return (uint32_t)mtimecmp;
+            case MTIMECMP_HI:   return (uint32_t)(mtimecmp >> 32);
+            case MTIME_LO:      return (uint32_t)get_mtime();
+            case MTIME_HI:      return (uint32_t)(get_mtime() >> 32);
+            default:            return 0;
+        }
+    }
+
+    bool mmio_store(uint32_t addr, uint32_t data, uint8_t mask) override {
+        uint64_t mtime = get_mtime();
+        switch(addr - CLINT_ADDR) {
+            case MTIMECMP_LO:   mtimecmp = merge(mtimecmp, 0, data, mask); break;
+            case MTIMECMP_HI:   mtimecmp = merge(mtimecmp, 32, data, mask); break;
+            case MTIME_LO:      mtime_offset = merge(mtime, 0, data, mask) - get_cycles(); break;
+            case MTIME_HI:      mtime_offset = merge(mtime, 32, data, mask) - get_cycles(); break;
+            default:            break;
+        }
+        return false;
+    }
+
+    void wfi() override {
+        // Sleep until mtime >= mtimecmp (forever in the core while mtimecmp
+        // has its reset value: a NOP here)
+        uint64_t mtime = get_mtime();
+        if(mtime < mtimecmp && mtimecmp != UINT64_MAX) {
+            sleep_cycles += mtimecmp - mtime;
+        }
+    }
+
+private:
+    // Merge the bytes of data selected by mask into the word of reg at shift
+    static uint64_t merge(uint64_t reg, unsigned shift, uint32_t data, uint8_t mask) {
+        for(int i = 0; i < 4; i++) {
+            if(mask & (1 << i)) {
+                uint64_t lane = 0xffull << (shift + i * 8);
+                reg = (reg & ~lane) | (((uint64_t)data << shift) & lane);
+            }
+        }
+        return reg;
+    }
+
+    Iss &iss;
+    uint64_t sleep_cycles = 0;
+    uint64_t mtime_offset = 0;          // mtime - cycles (mtime written)
+    uint64_t mtimecmp     = UINT64_MAX; // Reset value: never pending
 };
 
-class OrionSim {
+// Host file mapped into memory (--map)
+struct Mapping_t {
+    std::string file;
+    uint32_t    addr;
+    bool        ro;
+};
+
+// Architectural state (snapshot taken on the ISS)
+struct ArchState_t {
+    uint64_t instret;               // Instructions executed up to the snapshot
+    uint64_t cycles;                // ISS cycles (instructions and WFI sleep)
+    uint64_t mtime;                 // CLINT timer
+    uint64_t mtimecmp;
+    uint32_t pc;
+    uint32_t regs[32];
+    GuestMem::Pages_t mem;          // Pages that differ from the cleared memory
+};
+
+class OrionSim: public Iss::MmioHandler, public Vdev::Host, public BlkDev::Host {
 public:
-    OrionSim() {
+    OrionSim(unsigned nthreads = SIM_THREADS): vdev(this), blkdev(this) {
         // Initialize the simulator
         LOG(printf("%s", banner.c_str());)
         
@@ -137,8 +315,9 @@ public:
         SIMLOG("Memory map:\n");
         SIMLOG(" - RAM : 0x%08x (0x%x B)\n", MEM_ADDR, MEM_SIZE);
         SIMLOG(" - VDEV: 0x%08x (0x%x)\n", VDEV_ADDR, VDEV_SIZE);
+        SIMLOG("Simulation threads: %u\n", nthreads);
      
-        tb = new Testbench<Vorion_soc>();
+        tb = new Testbench<Vorion_soc>(nthreads);
         tb->register_clk((bool*)&tb->dut_->clk_i);
         tb->register_rst((bool*)&tb->dut_->rst_i);
 
@@ -158,121 +337,254 @@ public:
         signal_ptrs.mem_wmask   = (uint8_t*)&tb->dut_->orion_soc->core->writeback_stg->dbg_mem_wmask;
         signal_ptrs.mem_rdata   = (uint32_t*)&tb->dut_->orion_soc->core->writeback_stg->dbg_mem_rdata;
         signal_ptrs.mem_wdata   = (uint32_t*)&tb->dut_->orion_soc->core->writeback_stg->dbg_mem_wdata;
+        signal_ptrs.dmem_valid  = (bool*)&tb->dut_->orion_soc->dmem_valid_o;
+        signal_ptrs.dmem_addr   = (uint32_t*)&tb->dut_->orion_soc->dmem_addr_o;
+        signal_ptrs.dmem_we     = (bool*)&tb->dut_->orion_soc->dmem_we_o;
+        signal_ptrs.sleep       = (bool*)&tb->dut_->orion_soc->core->sleep_o;
+        signal_ptrs.dmem_pc     = (uint32_t*)&tb->dut_->orion_soc->core->dmem_pc;
+        signal_ptrs.st_commit       = (bool*)&tb->dut_->orion_soc->core->st_commit;
+        signal_ptrs.st_commit_addr  = (uint32_t*)&tb->dut_->orion_soc->core->st_commit_addr;
+        signal_ptrs.st_commit_wdata = (uint32_t*)&tb->dut_->orion_soc->core->st_commit_wdata;
+        signal_ptrs.st_commit_mask  = (uint8_t*)&tb->dut_->orion_soc->core->st_commit_mask;
+
+#ifdef SIM_MEM_DPI
+        // Memory timing model of the DPI memory
+        SIMLOG("Memory timing model: DPI\n");
+        tb->dut_->orion_soc->memory->model_h = (uint64_t)&mem_model;
+#endif
 
-        // Clear vdev registers
-        for(int addr = VDEV_ADDR; addr < (VDEV_ADDR + VDEV_SIZE); addr+=4) {
-            unsigned mem_index = (addr - MEM_ADDR) / 4;
-            tb->dut_->orion_soc->memory->mem[mem_index] = 0x00000000;
+        // Memory storage: sparse guest memory or the verilated array
+#ifdef SIM_MEM_SPARSE
+        SIMLOG("Sparse guest memory: %u MB\n", MEM_SIZE >> 20);
+        if(!guest_mem.reserve(MEM_SIZE)) {
+            // Reported by is_ready(), so that the caller returns and the
+            // destructors run
+            SIMERR("Could not reserve %u bytes of guest memory\n", MEM_SIZE);
         }
+        mem_base = guest_mem.get_words();
+        mem_model.set_store(mem_base);
+#else
+        mem_base = &tb->dut_->orion_soc->memory->mem[0];
+#endif
+        poll_warp = new PollWarp(mem_base, MEM_ADDR, MEM_SIZE, VDEV_ADDR + Vdev::CYCLE);
+
+        // Devices on the dmem port
+        mmio_bus.add("VDEV", VDEV_ADDR, VDEV_SIZE, &vdev);
     }
 
-    ~OrionSim() {
+    // The constructor set up the simulator (the guest memory could be reserved)
+    bool is_ready() { return mem_base != nullptr; }
+
+    ~OrionSim() override {
+        // Let the consumers drain the commit stream before their files close
+        commit_stream.stop();
+        delete text_log;
+
         // If trace is open, close it
-        if(log_f) {
-            fclose(log_f);
+        if(log_w.is_open()) {
+            bin_log.close();
+            log_w.close();
             SIMLOG("Closed trace file\n");
         }
 
+        if(bbv) {
+            bbv->close();
+            SIMLOG("Wrote %lu basic block vectors\n", bbv->get_nintervals());
+            delete bbv;
+        }
+
+        delete cosim_ref;
+        delete cosim_mmio;
+        delete poll_warp;
+
         // Clean up the simulator
         delete tb;
     }
 
-    void eval_vdev() {
-        // Evaluate the VDEV registers
+    void mmio_port_load() {
+        // A device load is presented on the dmem port: read the device into
+        // the memory word the clock edge reads
+        uint32_t addr = *signal_ptrs.dmem_addr;
+        MmioBus::Range_t *range = mmio_bus.decode(addr);
+        if(range) {
+            mem_base[(addr - MEM_ADDR) / 4] = range->dev->read(addr - range->addr);
+        }
+    }
 
-        // SIMUART
-        if((*signal_ptrs.instr_valid & 0x1) && 
-            (*signal_ptrs.mem_wmask & 0x1) &&
-            (*signal_ptrs.mem_addr == VDEV_CONSOLE_ADDR)) {
-                putchar(*signal_ptrs.mem_wdata & 0xFF);
-                fflush(stdout);
+    void mmio_commit_store() {
+        // A device store retires at the next clock edge: pass it to the device
+        // (before a younger load reads the device in the same cycle)
+        uint32_t addr = *signal_ptrs.st_commit_addr;
+        MmioBus::Range_t *range = mmio_bus.decode(addr);
+        if(range) {
+            range->dev->write(addr - range->addr, *signal_ptrs.st_commit_wdata, *signal_ptrs.st_commit_mask & 0xf);
         }
+    }
 
-        // // Console register (TX)
-        // if(BIT_GET(tb->dut_->orion_soc->memory->mem[(VDEV_CONSOLE_ADDR - MEM_ADDR)/4], 16)) {
-        //     // DEBUG
+    // VDEV counters and requests (ISS cycles while the ISS runs)
+    uint64_t vdev_cycles() override {
+        return tb->get_cycles() + (ff_clint ? ff_clint->get_cycles() : 0);
+    }
 
-        //     uint8_t tx_data = BITS_GET(tb->dut_->orion_soc->memory->mem[(VDEV_CONSOLE_ADDR - MEM_ADDR)/4], 7, 0);
-        //     putchar(tx_data);
-        //     fflush(stdout);
+    uint64_t vdev_instret() override {
+        return instret + (ff_iss ? ff_iss->get_instret() : 0);
+    }
 
-        //     // Clear TX valid bit
-        //     tb->dut_->orion_soc->memory->mem[(VDEV_CONSOLE_ADDR - MEM_ADDR)/4] = 
-        //         BIT_SET(tb->dut_->orion_soc->memory->mem[(VDEV_CONSOLE_ADDR - MEM_ADDR)/4], 16, 0);
-        // }
+    void vdev_putc(char c) override {
+        if(en_console)
+            console.putc(c);
+    }
 
-        // TODO: Console register (RX)
+    void vdev_finish(uint8_t ret_code) override {
+        term_req = true;
+        sw_ret_code = ret_code;
+    }
 
-        // Cycle register
-        uint64_t cycles = tb->get_cycles();
-        tb->dut_->orion_soc->memory->mem[(VDEV_CYCLE_ADDR    - MEM_ADDR)/4] = (uint32_t)cycles;
-        tb->dut_->orion_soc->memory->mem[(VDEV_CYCLE_ADDR_HI - MEM_ADDR)/4] = (uint32_t)(cycles >> 32);
+    bool open_blkdev(const std::string &filename, uint64_t latency) {
+        // Attach the block device backed by a host file
+        SIMLOG("Block device: %s @ 0x%08x (latency: %lu cycles)\n", filename.c_str(), BLKDEV_ADDR, latency);
+        if(!blkdev.open(filename)) {
+            SIMERR("Could not open block device file: %s: %s\n", filename.c_str(), strerror(errno));
+            return false;
+        }
+        blkdev.set_latency(latency);
+        mmio_bus.remove(&blkdev);
+        mmio_bus.add("BLKDEV", BLKDEV_ADDR, BLKDEV_SIZE, &blkdev);
+        return true;
+    }
 
-        // Instruction retired register
-        tb->dut_->orion_soc->memory->mem[(VDEV_INSTRET_ADDR    - MEM_ADDR)/4] = (uint32_t)instret;
-        tb->dut_->orion_soc->memory->mem[(VDEV_INSTRET_ADDR_HI - MEM_ADDR)/4] = (uint32_t)(instret >> 32);
-        
-        // Simulation control register
-        uint32_t simctrl = tb->dut_->orion_soc->memory->mem[(VDEV_SIMCTRL_ADDR - MEM_ADDR)/4];
-        if(BIT_GET(simctrl, 8)) {
-            term_req = true;
-            sw_ret_code = BITS_GET(simctrl, 7, 0);
-            tb->dut_->orion_soc->memory->mem[(VDEV_SIMCTRL_ADDR - MEM_ADDR)/4] = 
-                BIT_SET(tb->dut_->orion_soc->memory->mem[(VDEV_SIMCTRL_ADDR - MEM_ADDR)/4], 8, 0);
+    void close_blkdev() {
+        // Detach the block device
+        blkdev.close();
+        mmio_bus.remove(&blkdev);
+    }
+
+    // Block device DMA (cycles == instructions while the ISS runs)
+    uint64_t blk_cycles() override {
+        return vdev_cycles();
+    }
+
+    uint8_t *blk_dma_begin(uint32_t addr, uint32_t len) override {
+        if(addr < MEM_ADDR || (uint64_t)addr + len > (uint64_t)MEM_ADDR + MEM_SIZE) {
+            return nullptr;
+        }
+        for(auto &rom: roms) {
+            if(addr < rom.first + rom.second && rom.first < addr + len) {
+                return nullptr;
+            }
         }
+        return (uint8_t *)mem_base + (addr - MEM_ADDR);
     }
 
+    void blk_dma_end(uint32_t addr, uint32_t len) override {
+        // The reference model has its own copy of the memory
+        if(cosim_ref) {
+            memcpy((uint8_t *)cosim_mem.get_words() + (addr - MEM_ADDR), (uint8_t *)mem_base + (addr - MEM_ADDR), len);
+        }
+    }
 
     int run() {
         // Run the simulation
         SIMLOG("Starting simulation\n");
+        console.start();
 
-        SIMLOG("Resetting SoC\n");
-        tb->reset(RESET_CYCLES);
+        start();
 
         LOG(printf("----------------------------------------\n");)
 
-        // Tick the simulation
+        if(en_cosim && !cosim_ref) {
+            SIMWARN("Co-simulation needs to start from reset or a fast-forward point, disabled\n");
+            en_cosim = false;
+        }
+
+        start_commit_stream();
+
+        // Pick the main loop specialization once for the enabled features
+        run_loop_t run_loop = get_run_loop();
+
+        // Tick the simulation, stopping at event points (checkpoints, ROI
+        // start, instruction limit) on the way
+        uint64_t start_cycles = tb->get_cycles();
+        auto wall_start = std::chrono::steady_clock::now();
         while(1) {
-            if(tb->finished()) {
-                term_pc = *signal_ptrs.pc;
-                term_cause = TERM_CAUSE_FINISH;
+            if(stop_signal.load(std::memory_order_relaxed)) {
+                term_cause = TERM_CAUSE_SIGNAL;
+                break;
+            }
+            stop_instret = std::min(max_instret, roi_start_instret);
+            (this->*run_loop)(std::min({max_cycles, save_ckpt_at, tb->get_cycles() + SIM_STOP_POLL_CYCLES}));
+            if(term_cause != TERM_CAUSE_UNKNOWN) {
                 break;
             }
-
             if(tb->get_cycles() >= max_cycles) {
-                term_pc = *signal_ptrs.pc;
                 term_cause = TERM_CAUSE_MAX_CYCLES;
                 break;
             }
-            
-            if(term_req) {
-                term_pc = *signal_ptrs.pc;
-                term_cause = TERM_CAUSE_TERM_REQ;
-                break;
+            if(instret >= roi_start_instret) {
+                SIMLOG("ROI start @ cycle %lu (instret: %lu)\n", tb->get_cycles(), instret);
+                roi_start_cycles = tb->get_cycles();
+                roi_start_instret_actual = instret;
+                roi_started = true;
+                roi_start_instret = UINT64_MAX;
             }
-            
-            // Evaluate the VDEV registers
-            eval_vdev();
-
-            // Tick clock once
-            tb->tick();
-
-            // Dump log
-            if(log_f) {
-                sim_log();
+            if(instret >= max_instret) {
+                term_cause = TERM_CAUSE_MAX_INSTRET;
+                break;
             }
-            
-            // Increment the instruction retired counter
-            if (*signal_ptrs.instr_valid & 0x1) {
-                instret++;
+            if(tb->get_cycles() >= save_ckpt_at) {
+                save_ckpt_at = UINT64_MAX;
+                if(!save_checkpoint(ckpt_file)) {
+                    term_cause = TERM_CAUSE_CHECKPOINT;
+                    break;
+                }
             }
         }
+        term_pc = *signal_ptrs.pc;
+        std::chrono::duration<double> wall_time = std::chrono::steady_clock::now() - wall_start;
+        console.stop();
 
         LOG(printf("----------------------------------------\n");)
-        SIMLOG("Instructions executed: %lu\n", instret);
-        SIMLOG("IPC: %.6f\n", (float)instret/(float)tb->get_cycles());
+        if(en_instret) {
+            SIMLOG("Instructions executed: %lu\n", instret);
+            SIMLOG("IPC: %.6f\n", (float)instret/(float)tb->get_cycles());
+            if(ff_instret > 0) {
+                SIMLOG("IPC (RTL only, %lu instructions fast-forwarded): %.6f\n", ff_instret,
+                    (float)(instret - ff_instret)/(float)(tb->get_cycles() - ff_cycles));
+            }
+        }
         SIMLOG("Cycles: %lu (Time: %lu ps)\n", tb->get_cycles(), tb->get_time());       
+#ifdef SIM_MEM_DPI
+        for(unsigned port = 0; port < MemModel::NPORTS; port++) {
+            SIMLOG("%s: %lu accesses, average latency: %.3f cycles, wait cycles: %lu\n", port == MemModel::PORT_IMEM ? "IMEM" : "DMEM",
+                mem_model.get_accesses(port), mem_model.get_avg_latency(port), mem_model.get_wait_cycles(port));
+        }
+#endif
+        if(commit_stream.is_running()) {
+            SIMLOG("Commit stream: %lu records, producer waited on a full ring %lu times\n",
+                commit_stream.get_records(), commit_stream.get_waits());
+        }
+        if(idle_cycles > 0) {
+            SIMLOG("Idle cycles skipped (WFI): %lu\n", idle_cycles);
+        }
+        if(poll_warp->get_warps() > 0) {
+            SIMLOG("Polling loop cycles skipped: %lu (%lu warps)\n", poll_warp->get_cycles(), poll_warp->get_warps());
+        }
+        if(blkdev.is_open()) {
+            SIMLOG("Block device: %lu requests, %lu bytes\n", blkdev.get_requests(), blkdev.get_bytes());
+        }
+#ifdef SIM_MEM_SPARSE
+        SIMLOG("Guest memory resident: %lu KB of %u MB\n", guest_mem.get_resident() >> 10, MEM_SIZE >> 20);
+        if(mem_model.get_rom_writes() > 0) {
+            SIMWARN("Dropped %lu stores to read-only mappings\n", mem_model.get_rom_writes());
+        }
+#endif
+        if(roi_started) {
+            uint64_t roi_cycles = get_roi_cycles();
+            uint64_t roi_instret = get_roi_instret();
+            SIMLOG("ROI cycles: %lu, ROI instructions: %lu, ROI IPC: %.6f\n", roi_cycles, roi_instret,
+                roi_cycles > 0 ? (double)roi_instret / roi_cycles : 0.0);
+        }
+        SIMLOG("Simulation speed: %.3f kHz (wall time: %.3f s)\n", (tb->get_cycles() - start_cycles) / wall_time.count() / 1e3, wall_time.count());
         SIMLOG("Simulation finished @ PC: 0x%08x)\n", term_pc);
 
         // Check for termination cause
@@ -286,6 +598,22 @@ public:
                 SIMLOG("  Reached maximum cycles (%lu)\n", max_cycles);
                 rv = 1;
                 break;
+            case TERM_CAUSE_MAX_INSTRET:
+                SIMLOG("  Reached maximum retired instructions (%lu)\n", max_instret);
+                rv = 0;
+                break;
+            case TERM_CAUSE_COSIM:
+                SIMLOG("  Co-simulation mismatch (after %lu instructions)\n", instret);
+                rv = 1;
+                break;
+            case TERM_CAUSE_CHECKPOINT:
+                SIMLOG("  Could not save the checkpoint (%s)\n", ckpt_file.c_str());
+                rv = 1;
+                break;
+            case TERM_CAUSE_SIGNAL:
+                SIMLOG("  Interrupted by signal %d (%s)\n", stop_signal.load(), strsignal(stop_signal.load()));
+                rv = 1;
+                break;
             case TERM_CAUSE_TERM_REQ:
                 SIMLOG("  Termination request from software (retcode: %s%d%s)\n", sw_ret_code == 0 ? "\033[32m" : "\033[31m", sw_ret_code, "\033[0m");
                 rv = sw_ret_code;
@@ -298,147 +626,1241 @@ public:
         return rv;
     }
 
-    void open_trace(const std::string &filename) {
-        // Open the trace file
-        SIMLOG("Opening trace file: %s\n", filename.c_str());
-        tb->open_trace(filename);
+    void start() {
+        // Reset the SoC, unless it is already running (restored checkpoint or
+        // advanced to a snapshot point)
+        if(!started) {
+            SIMLOG("Resetting SoC\n");
+            tb->reset(RESET_CYCLES);
+            started = true;
+
+            if(start_state) {
+                load_arch_state(*start_state);
+            }
+            else if(ff_ninstrs > 0) {
+                fast_forward(ff_ninstrs);
+            }
+
+            if(en_cosim) {
+                cosim_init();
+            }
+        }
     }
 
-    void load_hex(const std::string &filename) {
-        // Load the hex file
-        SIMLOG("Loading hex file: %s\n", filename.c_str());
-        std::ifstream hex_file(filename);
-        if(!hex_file.is_open()) {
-            fprintf(stderr, "Error: Could not open hex file: %s\n", filename.c_str());
+    bool set_cosim(bool en) {
+        // Check every retired instruction against the reference model, which
+        // has its own copy of the memory. Returns false if it cannot be reserved
+        if(en) {
+            SIMLOG("Co-simulation enabled (reference: built-in RV32IM ISS)\n");
+            if(!cosim_mem.get_words() && !cosim_mem.reserve(MEM_SIZE)) {
+                SIMERR("Could not reserve the co-simulation memory\n");
+                return false;
+            }
+        }
+        en_cosim = en;
+        return true;
+    }
+
+    void cosim_init() {
+        // Start the reference model from the RTL architectural state: memory
+        // as loaded, PC and registers as reset/handed off
+        GuestMem::Pages_t pages;
+        GuestMem::save_pages(mem_base, MEM_SIZE, pages);
+        cosim_mem.clear();
+        GuestMem::load_pages(cosim_mem.get_words(), pages);
+        delete cosim_ref;
+        delete cosim_mmio;
+        cosim_ref = new Iss(cosim_mem.get_words(), MEM_ADDR, MEM_SIZE);
+        cosim_mmio = new CosimMmio(signal_ptrs.mem_addr, signal_ptrs.mem_rdata);
+        cosim_ref->set_mmio(mmio_bus.get_addr(), mmio_bus.get_size(), cosim_mmio);
+        cosim_ref->add_io(CLINT_ADDR, CLINT_SIZE, cosim_mmio);
+        for(auto &rom: roms) {
+            cosim_ref->add_rom(rom.first, rom.second);
+        }
+        cosim_ref->reset(tb->dut_->orion_soc->core->fetch_stg->pc);
+        for(unsigned i = 1; i < 32; i++) {
+            cosim_ref->set_reg(i, tb->dut_->orion_soc->core->decode_stg->reg_f->regs[i]);
+        }
+    }
+
+    void cosim_mismatch(const char *what, uint32_t expected, uint32_t got) {
+        SIMERR("Co-simulation mismatch @ cycle %lu, PC: 0x%08x (instr: 0x%08x)\n", tb->get_cycles(), *signal_ptrs.pc, *signal_ptrs.instr);
+        SIMERR("  %s: expected 0x%08x, got 0x%08x\n", what, expected, got);
+        term_cause = TERM_CAUSE_COSIM;
+    }
+
+    void cosim_check() {
+        // Step the reference model over the retired instruction and compare
+        // its side effects
+        if(cosim_ref->get_pc() != *signal_ptrs.pc) {
+            cosim_mismatch("PC", cosim_ref->get_pc(), *signal_ptrs.pc);
+            return;
+        }
+        if(cosim_ref->run(1) != 1) {
+            SIMERR("Co-simulation reference model could not execute PC: 0x%08x (%s)\n", cosim_ref->get_pc(),
+                cosim_ref->get_stop_cause() == ISS_STOP_MEM_FAULT ? "memory fault" : "illegal instruction");
+            term_cause = TERM_CAUSE_COSIM;
+            return;
+        }
+        const Iss_commit_t &c = cosim_ref->get_commit();
+        if(c.instr != *signal_ptrs.instr) {
+            cosim_mismatch("Instruction", c.instr, *signal_ptrs.instr);
             return;
         }
 
-        std::string line;
-        uint32_t addr = 0x0000000;          // Local to memory
-        uint64_t nbytes_written = 0;
+        uint8_t rd = (*signal_ptrs.rd_we & 0x1) ? (*signal_ptrs.rd_s & 0x1f) : 0;
+        if(rd != c.rd) {
+            cosim_mismatch("rd", c.rd, rd);
+            return;
+        }
+        if(rd != 0 && *signal_ptrs.rd_v != c.rd_v) {
+            cosim_mismatch("rd value", c.rd_v, *signal_ptrs.rd_v);
+            return;
+        }
 
-        while(std::getline(hex_file, line)) {
-            if(line.empty()) continue;
-            
-            // Update address if line starts with '@'
-            if(line[0] == '@') {
-                std::runtime_error("Address parsing not implemented");
-                // addr = std::stoul(line.substr(1, line.size() - 1), nullptr, 16);
-                continue;
+        uint8_t rmask = *signal_ptrs.mem_rmask & 0xf;
+        uint8_t wmask = *signal_ptrs.mem_wmask & 0xf;
+        if(rmask != c.mem_rmask) {
+            cosim_mismatch("Load mask", c.mem_rmask, rmask);
+            return;
+        }
+        if(wmask != c.mem_wmask) {
+            cosim_mismatch("Store mask", c.mem_wmask, wmask);
+            return;
+        }
+        if((rmask || wmask) && *signal_ptrs.mem_addr != c.mem_addr) {
+            cosim_mismatch("Memory address", c.mem_addr, *signal_ptrs.mem_addr);
+            return;
+        }
+        if(wmask) {
+            uint32_t lanes = 0;
+            for(int i = 0; i < 4; i++) {
+                lanes |= (wmask & (1 << i)) ? (0xffu << (i * 8)) : 0;
             }
-
-            // Parse the data line
-            uint32_t data = std::stoul(line, nullptr, 16);
-            
-            // Check if the address is within the valid range
-            if(!(/*addr >= MEM_ADDR || */  addr < /*MEM_ADDR +*/ MEM_SIZE)) {
-                fprintf(stderr, "Error: Address out of range: 0x%08X\n", addr);
-                fprintf(stderr, "       Memory Initializatioin failed");
-                exit(1);
+            if((*signal_ptrs.mem_wdata & lanes) != c.mem_wdata) {
+                cosim_mismatch("Store data", c.mem_wdata, *signal_ptrs.mem_wdata & lanes);
+                return;
             }
-            
-            // Write the data word to the memory
-            uint32_t memory_word_index = (addr /*- MEM_ADDR*/) / 4;
-            tb->dut_->orion_soc->memory->mem[memory_word_index] = data;
-            addr += 4;
-            nbytes_written += 4;
         }
+    }
 
-        hex_file.close();
-        SIMLOG("Loaded %lu bytes in memory\n", nbytes_written);
+    void set_fast_forward(uint64_t ninstrs) {
+        // Execute the first ninstrs instructions on the ISS
+        SIMLOG("Fast-forwarding %lu instructions\n", ninstrs);
+        ff_ninstrs = ninstrs;
     }
 
-    void dump_mem(std::string filename) {
-        SIMLOG("Dumping memory to file: %s\n", filename.c_str());
-        std::ofstream dump_file(filename, std::ios::binary);
-        if(!dump_file.is_open()) {
-            fprintf(stderr, "Error: Could not open dump file: %s\n", filename.c_str());
-            return;
+    void fast_forward(uint64_t ninstrs) {
+        // Execute instructions on the ISS (right after reset) and hand off the
+        // architectural state to the RTL. The ISS works on the dpram memory in
+        // place; each executed instruction counts as one cycle (plus the WFI
+        // sleep cycles, IssClint) so that the VDEV counters and the timer stay
+        // monotonic across the switch.
+        Iss iss(mem_base, MEM_ADDR, MEM_SIZE);
+        IssClint clint(iss);
+        init_iss(iss, clint);
+
+        ff_iss = &iss;
+        ff_clint = &clint;
+        auto wall_start = std::chrono::steady_clock::now();
+        uint64_t n = iss.run(ninstrs);
+        std::chrono::duration<double> wall_time = std::chrono::steady_clock::now() - wall_start;
+        ff_iss = nullptr;
+        ff_clint = nullptr;
+
+        instret += n;
+        ff_instret = n;
+        ff_cycles = clint.get_cycles();
+        tb->skip_cycles(ff_cycles);
+        SIMLOG("Fast-forwarded %lu instructions (%.3f MIPS), switching to RTL @ PC: 0x%08x\n",
+            n, n / wall_time.count() / 1e6, iss.get_pc());
+        switch(iss.get_stop_cause()) {
+            case ISS_STOP_ILLEGAL_INSTR:
+                SIMWARN("ISS stopped on an illegal instruction @ PC: 0x%08x\n", iss.get_pc());
+                break;
+            case ISS_STOP_MEM_FAULT:
+                SIMWARN("ISS stopped on a memory fault @ PC: 0x%08x\n", iss.get_pc());
+                break;
+            default:
+                break;
         }
-        for(uint32_t word_indx = 0; word_indx < MEM_SIZE / 4; word_indx++) {
-            uint32_t data = tb->dut_->orion_soc->memory->mem[word_indx];
-            dump_file << std::hex << std::setw(8) << std::setfill('0') << data << "\n";
+
+        uint32_t regs[32];
+        for(unsigned i = 0; i < 32; i++) {
+            regs[i] = iss.get_reg(i);
         }
-        dump_file.close();
+        handoff(iss.get_pc(), regs, clint.get_mtime(), clint.get_mtimecmp());
     }
 
-    void set_max_cycles(uint64_t cycles) {
-        // Set the maximum number of cycles
-        SIMLOG("Setting maximum cycles to: %lu\n", cycles);
-        max_cycles = cycles;
+    void init_iss(Iss &iss, IssClint &clint) {
+        // Devices and read-only ranges of the fast-forward ISS, reset to the
+        // start of the RAM
+        iss.set_mmio(mmio_bus.get_addr(), mmio_bus.get_size(), this);
+        iss.add_io(CLINT_ADDR, CLINT_SIZE, &clint);
+        iss.set_wfi(&clint);
+        for(auto &rom: roms) {
+            iss.add_rom(rom.first, rom.second);
+        }
+        iss.reset(MEM_ADDR);
     }
 
-    void sim_log() {
-        if (log_format == "spike") {
-            if(! *signal_ptrs.instr_valid) {
-                return; // skip bubbles
-            }
-            /*
-            Spike format:
-                default:    core  {core_id}: <priv> <pc> (<instr>)
-                reg update: core  {core_id}: <priv> <pc> (<instr>) <rd> <new_value>
-                store;      core  {core_id}: <priv> <pc> (<instr>) mem <store_target_address> <data_to_store>
-                load;       core  {core_id}: <priv> <pc> (<instr>) rd <loaded_data> mem <load_target_address>
-            */
-            fprintf(log_f, "core   0: 3 0x%08x (0x%08x)", *signal_ptrs.pc, *signal_ptrs.instr);
-            if(*signal_ptrs.mem_rmask & 0xf) {
-                // rd <loaded_data> mem <load_target_address>
-                fprintf(log_f, " x%-2d 0x%08x mem 0x%08x", *signal_ptrs.rd_s & 0x1f, *signal_ptrs.mem_rdata, *signal_ptrs.mem_addr);
+    void handoff(uint32_t pc, const uint32_t *regs, uint64_t mtime, uint64_t mtimecmp) {
+        // Hand off the PC and registers to the RTL right after reset. The
+        // fetch address (pc_next, combinational) is only recomputed from the
+        // written PC when an input it depends on changes: hold reset while
+        // writing (the clock stays low, nothing is clocked) and release it,
+        // so that the next eval of either tick path fetches from the written
+        // PC (pc_next follows pc while the memory response is pending after
+        // reset). test/fast_forward checks the handoff against full RTL runs.
+        tb->dut_->rst_i = 1;
+        tb->dut_->eval();
+        tb->dut_->orion_soc->core->fetch_stg->pc = pc;
+        for(unsigned i = 0; i < 32; i++) {
+            tb->dut_->orion_soc->core->decode_stg->reg_f->regs[i] = regs[i];
+        }
+        tb->dut_->orion_soc->clint->mtime = mtime;
+        tb->dut_->orion_soc->clint->mtimecmp = mtimecmp;
+        tb->dut_->rst_i = 0;
+    }
+
+    void set_start_state(const ArchState_t *state) {
+        // Start from an architectural snapshot instead of the reset state
+        start_state = state;
+    }
+
+    void load_arch_state(const ArchState_t &state) {
+        // Load a snapshot right after reset (the ISS cycles before the snapshot
+        // count, as when fast-forwarding)
+        clear_mem();
+        GuestMem::load_pages(mem_base, state.mem);
+        handoff(state.pc, state.regs, state.mtime, state.mtimecmp);
+        instret += state.instret;
+        ff_instret = state.instret;
+        ff_cycles = state.cycles;
+        tb->skip_cycles(state.cycles);
+        SIMLOG("Loaded architectural state @ instret %lu, PC: 0x%08x\n", state.instret, state.pc);
+    }
+
+    uint64_t take_arch_states(const std::vector<uint64_t> &points, std::vector<ArchState_t> &states, uint64_t max_instrs) {
+        // Run the loaded program on the ISS and snapshot the architectural
+        // state when the instruction count reaches each of the (sorted)
+        // points. Returns the number of instructions executed until the
+        // program ended (or max_instrs). Memory is left modified.
+        Iss iss(mem_base, MEM_ADDR, MEM_SIZE);
+        IssClint clint(iss);
+        init_iss(iss, clint);
+
+        ff_iss = &iss;
+        ff_clint = &clint;
+        for(uint64_t point: points) {
+            iss.run(point - iss.get_instret());
+            if(iss.get_instret() < point) {
+                break;
             }
-            else if(*signal_ptrs.mem_wmask & 0xf) {
-                // mem <store_target_address> <data_to_store>
-                fprintf(log_f, " mem 0x%08x 0x%s", *signal_ptrs.mem_addr, get_masked_hexstr(*signal_ptrs.mem_wdata, *signal_ptrs.mem_wmask).c_str());
+            ArchState_t state;
+            state.instret = iss.get_instret();
+            state.cycles = clint.get_cycles();
+            state.mtime = clint.get_mtime();
+            state.mtimecmp = clint.get_mtimecmp();
+            state.pc = iss.get_pc();
+            for(unsigned i = 0; i < 32; i++) {
+                state.regs[i] = iss.get_reg(i);
             }
-            else if((*signal_ptrs.rd_we & 0x1) && ((*signal_ptrs.rd_s & 0x1f) != 0)) {
-                fprintf(log_f, " x%-2d 0x%08x", *signal_ptrs.rd_s & 0x1f, *signal_ptrs.rd_v);
-            } 
-            
-        } else {
-            fprintf(log_f, "[%8lu] %s ", tb->get_cycles(), *signal_ptrs.instr_valid ? "       " : "INVALID");
-            fprintf(log_f, "PC: 0x%08x, Instr: 0x%08x, ", *signal_ptrs.pc, *signal_ptrs.instr);
-            fprintf(log_f, "rd: (x%-2d: 0x%08x, we: %d), ", *signal_ptrs.rd_s & 0x1f, *signal_ptrs.rd_v, *signal_ptrs.rd_we);
-            fprintf(log_f, "rs1: (x%-2d: 0x%08x), ", *signal_ptrs.rs1_s & 0x1f, *signal_ptrs.rs1_v);
-            fprintf(log_f, "rs2: (x%-2d: 0x%08x) ", *signal_ptrs.rs2_s & 0x1f, *signal_ptrs.rs2_v);
+#ifdef SIM_MEM_SPARSE
+            guest_mem.save_pages(state.mem);
+#else
+            GuestMem::save_pages(mem_base, MEM_SIZE, state.mem);
+#endif
+            states.push_back(std::move(state));
         }
-        fprintf(log_f, "\n");
-        fflush(log_f);
+        if(iss.get_stop_cause() == ISS_STOP_NONE && iss.get_instret() < max_instrs) {
+            iss.run(max_instrs - iss.get_instret());
+        }
+        ff_iss = nullptr;
+        ff_clint = nullptr;
+
+        // The ISS run is not part of the simulation
+        term_req = false;
+        sw_ret_code = 0;
+        return iss.get_instret();
     }
 
-    void open_log(const std::string &filename) {
-        // Open the simulation log file
-        SIMLOG("Opening simulation log file: %s\n", filename.c_str());
-        log_f = fopen(filename.c_str(), "w");
-        if(!log_f) {
-            fprintf(stderr, "Error: Could not open sim log file: %s\n", filename.c_str());
-            return;
-        }
+    void set_console(bool en) {
+        // Enable/disable console output
+        en_console = en;
     }
 
-    void set_log_format(const std::string &format) {
-        // Set the log format
-        SIMLOG("Setting log format to: %s\n", format.c_str());
-        if(format == "spike") {
-            log_format = "spike";
-        } else if(format == "default") {
-            log_format = "default";
-        } else {
-            fprintf(stderr, "Error: Unknown log format: %s\n", format.c_str());
-            return;
+    // Devices as seen by the ISS (the bus window may have gaps of plain memory)
+    uint32_t mmio_load(uint32_t addr) override {
+        MmioBus::Range_t *range = mmio_bus.decode(addr);
+        if(range) {
+            return range->dev->read(addr - range->addr);
         }
+        return mem_base[(addr - MEM_ADDR) / 4];
     }
 
-private:
-    Testbench<Vorion_soc> *tb;
-    uint64_t max_cycles = SIM_MAX_CYCLES;
+    bool mmio_store(uint32_t addr, uint32_t data, uint8_t mask) override {
+        MmioBus::Range_t *range = mmio_bus.decode(addr);
+        if(range) {
+            range->dev->write(addr - range->addr, data, mask);
+            return term_req;
+        }
+        uint32_t &word = mem_base[(addr - MEM_ADDR) / 4];
+        for(int i = 0; i < 4; i++) {
+            if(mask & (1 << i)) {
+                word = (word & ~(0xffu << (i * 8))) | (data & (0xffu << (i * 8)));
+            }
+        }
+        return false;
+    }
 
-    // Retired instruction counter
-    uint64_t instret = 0;
-    
-    // Simulation control
-    bool         term_req    = false;
-    uint32_t     term_pc     = 0;
-    Term_cause_t term_cause  = TERM_CAUSE_UNKNOWN;
-    int          sw_ret_code = 0;
+    bool advance_to_cycle(uint64_t cycle) {
+        // Simulate (without the end of run report) until the cycle count
+        // reaches the given cycle. Returns false if the simulation terminated
+        // on the way.
+        start();
+        run_loop_t run_loop = get_run_loop();
+        (this->*run_loop)(std::min(cycle, max_cycles));
+        return term_cause == TERM_CAUSE_UNKNOWN && tb->get_cycles() >= cycle;
+    }
+
+    bool advance_to_pc(uint32_t pc) {
+        // Simulate (without the end of run report) until an instruction at the
+        // given PC retires. Returns false if the simulation terminated (or
+        // reached max cycles) on the way.
+        start();
+        run_loop_t run_loop = get_run_loop();
+        while(term_cause == TERM_CAUSE_UNKNOWN && tb->get_cycles() < max_cycles) {
+            (this->*run_loop)(tb->get_cycles() + 1);
+            if((*signal_ptrs.instr_valid & 0x1) && *signal_ptrs.pc == pc) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Main simulation loop, specialized on the enabled features so that a run
+    // has no per-cycle checks for features it does not use.
+    //  EN_LOG:     feed the commit stream (log, BBV) and/or run the
+    //              co-simulation check
+    //  EN_TRACE:   tick with trace dumps (otherwise the fast-clock path)
+    //  EN_MMIO:    decode the dmem port against the device bus and honor
+    //              termination requests
+    //  EN_INSTRET: count retired instructions (and stop at stop_instret)
+    //  EN_IDLE:    skip the cycles the core sleeps in WFI (untraced runs)
+    //  EN_WARP:    skip the periods of loops polling the VDEV cycle counter
+    // Returns when the simulation terminates (term_cause is set) or when the
+    // cycle count reaches stop_cycle or the retired instructions stop_instret.
+    template <bool EN_LOG, bool EN_TRACE, bool EN_MMIO, bool EN_INSTRET, bool EN_IDLE, bool EN_WARP>
+    void run_loop(uint64_t stop_cycle) {
+        const bool *instr_valid = signal_ptrs.instr_valid;
+        const bool *dmem_valid = signal_ptrs.dmem_valid;
+        const uint32_t *dmem_addr = signal_ptrs.dmem_addr;
+        const bool *dmem_we = signal_ptrs.dmem_we;
+        const bool *st_commit = signal_ptrs.st_commit;
+        const uint32_t *st_commit_addr = signal_ptrs.st_commit_addr;
+        const bool *sleep = signal_ptrs.sleep;
+        uint64_t ncycles = stop_cycle > tb->get_cycles() ? stop_cycle - tb->get_cycles() : 0;
+
+        // Termination requests come from device stores: checked on entry and
+        // after a store only
+        bool check_term = EN_MMIO;
+
+        while(1) {
+            if(tb->finished()) {
+                term_cause = TERM_CAUSE_FINISH;
+                break;
+            }
+
+            if(ncycles-- == 0) {
+                break;
+            }
+
+            if(EN_INSTRET && instret >= stop_instret) {
+                break;
+            }
+
+            if(EN_MMIO) {
+                if(check_term) {
+                    if(term_req) {
+                        term_cause = TERM_CAUSE_TERM_REQ;
+                        break;
+                    }
+                    check_term = false;
+                }
+
+                // Device store retiring at this edge, then device load on the
+                // dmem port (the address tests fail on almost every cycle, so
+                // they go first)
+                if(mmio_bus.in_window(*st_commit_addr) && (*st_commit & 0x1)) {
+                    mmio_commit_store();
+                    check_term = true;
+                }
+                if(mmio_bus.in_window(*dmem_addr) && (*dmem_valid & 0x1) && !(*dmem_we & 0x1)) {
+                    if(EN_WARP)
+                        warp_poll(ncycles);
+                    mmio_port_load();
+                }
+            }
+
+            // Skip to the timer deadline while sleeping in WFI
+            if(EN_IDLE && (*sleep & 0x1))
+                skip_idle(ncycles);
+
+            // Tick clock once
+            if(EN_TRACE)
+                tb->tick_full();
+            else
+                tb->tick_fast();
+
+            // Dump log / co-simulation check
+            if(EN_LOG) {
+                sim_log();
+                if(term_cause != TERM_CAUSE_UNKNOWN)
+                    break;
+            }
+
+            // Increment the instruction retired counter
+            if(EN_INSTRET)
+                instret += *instr_valid & 0x1;
+
+            // Record a candidate polling loop
+            if(EN_WARP && poll_warp->is_recording() && (*instr_valid & 0x1))
+                poll_warp->retire(*signal_ptrs.pc, *signal_ptrs.instr, *signal_ptrs.mem_addr,
+                    *signal_ptrs.mem_rmask & 0xf, *signal_ptrs.mem_wmask & 0xf);
+        }
+
+        // Let the consumers see the last records
+        if(EN_LOG)
+            commit_stream.flush();
+    }
+
+    void skip_idle(uint64_t &ncycles) {
+        // Sleeping in WFI, nothing but mtime changes until the timer interrupt
+        // is pending: advance mtime and the cycle count (at most ncycles) to
+        // the cycle before the wake-up edge, then tick from there
+        auto *clint = tb->dut_->orion_soc->clint;
+        if(clint->mtime >= clint->mtimecmp) {
+            return;
+        }
+        uint64_t n = std::min<uint64_t>(clint->mtimecmp - clint->mtime - 1, ncycles);
+        clint->mtime += n;
+        tb->skip_cycles(n);
+        ncycles -= n;
+        idle_cycles += n;
+    }
+
+    void warp_poll(uint64_t &ncycles) {
+        // A load on the dmem port: if it reads the VDEV cycle counter in a
+        // loop that only polls it, skip whole periods of the loop (at most
+        // ncycles and up to stop_instret), advancing the counters the guest
+        // observes as if they were simulated
+        uint32_t addr = *signal_ptrs.dmem_addr & ~0x3u;
+        if((*signal_ptrs.dmem_we & 0x1) || addr - (VDEV_ADDR + Vdev::CYCLE) >= 8) {
+            return;
+        }
+        if(!poll_warp->poll(*signal_ptrs.dmem_pc, vdev_cycles(), vdev_instret())) {
+            return;
+        }
+        uint64_t period_cycles = poll_warp->get_period_cycles();
+        uint64_t period_instrs = poll_warp->get_period_instrs();
+        uint64_t max_periods = ncycles / period_cycles;
+        max_periods = std::min(max_periods, stop_instret > instret ? (stop_instret - instret) / period_instrs : 0);
+
+        uint32_t regs[32];
+        for(int i = 0; i < 32; i++) {
+            regs[i] = tb->dut_->orion_soc->core->decode_stg->reg_f->regs[i];
+        }
+        uint64_t n = poll_warp->plan(regs, max_periods);
+        if(n == 0) {
+            return;
+        }
+        tb->dut_->orion_soc->clint->mtime += n * period_cycles;
+        tb->skip_cycles(n * period_cycles);
+        ncycles -= n * period_cycles;
+        instret += n * period_instrs;
+    }
+
+    typedef void (OrionSim::*run_loop_t)(uint64_t);
+
+    run_loop_t get_run_loop() {
+        // The busy-wait warp needs the retired instructions of the skipped
+        // periods to not be observed. With the DPI memory neither the warp nor
+        // the idle skip applies: its timing is not periodic (jitter,
+        // bandwidth), a sleeping core still fetches through it every cycle,
+        // and its state and statistics would miss the skipped accesses.
+        bool en_log = commit_stream.is_running() || cosim_ref != nullptr;
+#ifdef SIM_MEM_DPI
+        bool en_warp = false;
+        bool en_idle = false;
+#else
+        bool en_warp = en_poll_warp && en_vdev && !en_log && tb->is_fast_tick();
+        bool en_idle = en_idle_skip && tb->is_fast_tick();
+#endif
+        poll_warp->set_dev_window(mmio_bus.get_addr(), mmio_bus.get_size());
+        return pick_run_loop(en_log, !tb->is_fast_tick(), !mmio_bus.empty(), en_instret, en_idle, en_warp);
+    }
+
+    // Select run_loop<...> from runtime feature flags (one flag per template argument)
+    template <bool... EN>
+    run_loop_t pick_run_loop() {
+        return &OrionSim::run_loop<EN...>;
+    }
+
+    template <bool... EN, typename... Flags>
+    run_loop_t pick_run_loop(bool en, Flags... flags) {
+        return en ? pick_run_loop<EN..., true>(flags...) : pick_run_loop<EN..., false>(flags...);
+    }
+
+    void set_vdev(bool en) {
+        // Enable/disable VDEV evaluation (VDEV needs the instret counter)
+        if(!en) {
+            SIMLOG("VDEV disabled\n");
+        }
+        if(en != en_vdev) {
+            if(en)
+                mmio_bus.add("VDEV", VDEV_ADDR, VDEV_SIZE, &vdev);
+            else
+                mmio_bus.remove(&vdev);
+        }
+        en_vdev = en;
+        en_instret = en_instret || en_vdev;
+    }
+
+    void set_idle_skip(bool en) {
+        // Enable/disable skipping the cycles the core sleeps in WFI
+        if(!en) {
+            SIMLOG("Idle cycle skipping disabled\n");
+        }
+        en_idle_skip = en;
+    }
+
+    void set_poll_warp(bool en) {
+        // Enable/disable skipping the periods of loops polling the cycle counter
+        if(en) {
+            SIMLOG("Busy-wait time warp enabled\n");
+        }
+        en_poll_warp = en;
+    }
+
+    void set_instret(bool en) {
+        // Enable/disable counting retired instructions
+        if(!en && en_vdev) {
+            SIMWARN("Instruction counting is required by VDEV, keeping it enabled\n");
+            return;
+        }
+        en_instret = en;
+    }
+
+    void set_max_instret(uint64_t n) {
+        // Stop after n retired instructions (including fast-forwarded ones)
+        SIMLOG("Setting maximum retired instructions to: %lu\n", n);
+        max_instret = n;
+        en_instret = true;
+    }
+
+    void set_roi_start(uint64_t n) {
+        // Start the region of interest (reported separately) after n retired
+        // instructions
+        SIMLOG("ROI starts after %lu instructions\n", n);
+        roi_start_instret = n;
+        en_instret = true;
+    }
+
+    bool open_bbv(const std::string &filename, uint64_t interval) {
+        // Profile basic block vectors over intervals of the given length
+        SIMLOG("Writing basic block vectors (interval: %lu instructions) to: %s\n", interval, filename.c_str());
+        if(interval == 0) {
+            fprintf(stderr, "Error: BBV interval must be non-zero\n");
+            return false;
+        }
+        bbv = new Bbv;
+        if(!bbv->open(filename, interval)) {
+            fprintf(stderr, "Error: Could not open BBV file: %s\n", filename.c_str());
+            delete bbv;
+            bbv = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    void set_save_checkpoint(uint64_t cycle, const std::string &filename) {
+        // Save a checkpoint when the cycle count reaches the given cycle
+        SIMLOG("Checkpoint will be saved at cycle %lu to: %s\n", cycle, filename.c_str());
+        save_ckpt_at = cycle;
+        ckpt_file = filename;
+    }
+
+    /*
+        Checkpoint format:
+            CKPT_MAGIC, CKPT_VERSION
+            Testbench state (cycles, time) and the verilated model state
+            (pipeline, regfile, memory)
+            OrionSim state (instret, term_req, sw_ret_code)
+            Device state: size and data of each device on the bus
+            Memory timing model state (DPI memory builds only)
+            Sparse memory builds only (the verilated model has no memory
+            array):
+              File mappings: count, then address, read-only flag, size and
+              name of each (mapped again on restore, the files must not
+              change)
+              Pages that differ from the cleared memory (non-zero, written
+              mapped pages): count, then offset and data of each
+        Verilator checks that the model matches the one that saved it.
+    */
+    bool save_checkpoint(const std::string &filename) {
+#ifdef SIM_SAVABLE
+        SIMLOG("Saving checkpoint @ cycle %lu: %s\n", tb->get_cycles(), filename.c_str());
+        VerilatedSave os;
+        os.open(filename.c_str());
+        if(!os.isOpen()) {
+            SIMERR("Could not open checkpoint file: %s\n", filename.c_str());
+            return false;
+        }
+        uint32_t version = CKPT_VERSION;
+        os.write(CKPT_MAGIC, sizeof(CKPT_MAGIC));
+        os.write(&version, sizeof(version));
+        tb->save_state(os);
+        os.write(&instret, sizeof(instret));
+        os.write(&term_req, sizeof(term_req));
+        os.write(&sw_ret_code, sizeof(sw_ret_code));
+        for(auto &range: mmio_bus.get_ranges()) {
+            uint64_t size = range.dev->get_state_size();
+            os.write(&size, sizeof(size));
+            if(size > 0)
+                os.write(range.dev->get_state(), size);
+        }
+#ifdef SIM_MEM_DPI
+        mem_model.save(os);
+#endif
+#ifdef SIM_MEM_SPARSE
+        uint64_t nmappings = mappings.size();
+        os.write(&nmappings, sizeof(nmappings));
+        for(auto &m: mappings) {
+            struct stat st;
+            uint64_t size = stat(m.file.c_str(), &st) == 0 ? st.st_size : 0;
+            uint8_t ro = m.ro;
+            uint64_t len = m.file.size();
+            os.write(&m.addr, sizeof(m.addr));
+            os.write(&ro, sizeof(ro));
+            os.write(&size, sizeof(size));
+            os.write(&len, sizeof(len));
+            os.write(m.file.data(), len);
+        }
+        GuestMem::Pages_t pages;
+        guest_mem.save_pages(pages);
+        uint64_t npages = pages.size();
+        os.write(&npages, sizeof(npages));
+        for(auto &page: pages) {
+            uint64_t offset = page.offset;
+            os.write(&offset, sizeof(offset));
+            os.write(page.data.data(), page.data.size());
+        }
+#endif
+        // A failed write closes the file (when Verilator does not abort on it)
+        os.flush();
+        if(!os.isOpen()) {
+            SIMERR("Could not write checkpoint file: %s\n", filename.c_str());
+            return false;
+        }
+        os.close();
+        return true;
+#else
+        SIMERR("Checkpoints are not supported by this build (SAVABLE=0)\n");
+        return false;
+#endif
+    }
+
+    bool restore_checkpoint(const std::string &filename) {
+#ifdef SIM_SAVABLE
+        SIMLOG("Restoring checkpoint: %s\n", filename.c_str());
+        VerilatedRestore is;
+        is.open(filename.c_str());
+        if(!is.isOpen()) {
+            SIMERR("Could not open checkpoint file: %s\n", filename.c_str());
+            return false;
+        }
+        char magic[sizeof(CKPT_MAGIC)];
+        uint32_t version = 0;
+        is.read(magic, sizeof(magic));
+        is.read(&version, sizeof(version));
+        if(memcmp(magic, CKPT_MAGIC, sizeof(magic)) != 0 || version != CKPT_VERSION) {
+            SIMERR("Not an orionsim checkpoint (or unsupported version): %s\n", filename.c_str());
+            return false;
+        }
+        tb->restore_state(is);
+        is.read(&instret, sizeof(instret));
+        is.read(&term_req, sizeof(term_req));
+        is.read(&sw_ret_code, sizeof(sw_ret_code));
+        for(auto &range: mmio_bus.get_ranges()) {
+            uint64_t size = 0;
+            is.read(&size, sizeof(size));
+            if(size != range.dev->get_state_size()) {
+                SIMERR("Checkpoint does not match the device %s\n", range.name.c_str());
+                return false;
+            }
+            if(size > 0)
+                is.read(range.dev->get_state(), size);
+        }
+#ifdef SIM_MEM_DPI
+        mem_model.restore(is);
+        tb->dut_->orion_soc->memory->model_h = (uint64_t)&mem_model;   // Saved by another process
+#endif
+#ifdef SIM_MEM_SPARSE
+        // Map the files and register the read-only ranges again (the pages
+        // that were not written read back from the files), then load the
+        // saved pages over them
+        uint64_t nmappings = 0;
+        is.read(&nmappings, sizeof(nmappings));
+        if(!mappings.empty() || !data_images.empty()) {
+            SIMWARN("File mappings and data images are restored from the checkpoint, --map and --load-bin ignored\n");
+        }
+        mappings.clear();
+        roms.clear();
+        mem_model.clear_roms();
+        for(uint64_t i = 0; i < nmappings; i++) {
+            Mapping_t m;
+            uint8_t ro = 0;
+            uint64_t size = 0, len = 0;
+            is.read(&m.addr, sizeof(m.addr));
+            is.read(&ro, sizeof(ro));
+            is.read(&size, sizeof(size));
+            is.read(&len, sizeof(len));
+            if(len > PATH_MAX) {
+                SIMERR("Corrupt checkpoint file mapping\n");
+                return false;
+            }
+            m.file.resize(len);
+            is.read(&m.file[0], len);
+            m.ro = ro;
+            struct stat st;
+            if(stat(m.file.c_str(), &st) != 0 || (uint64_t)st.st_size != size) {
+                SIMERR("Mapped file missing or changed since the checkpoint: %s\n", m.file.c_str());
+                return false;
+            }
+            if(!map_file(m.file, m.addr, m.ro)) {
+                return false;
+            }
+            mappings.push_back(m);
+        }
+        uint64_t npages = 0;
+        is.read(&npages, sizeof(npages));
+        clear_mem();
+        for(uint64_t i = 0; i < npages; i++) {
+            uint64_t offset = 0;
+            is.read(&offset, sizeof(offset));
+            if(offset + GuestMem::PAGE_BYTES > MEM_SIZE) {
+                SIMERR("Corrupt checkpoint memory page: 0x%lx\n", offset);
+                return false;
+            }
+            is.read((uint8_t *)mem_base + offset, GuestMem::PAGE_BYTES);
+        }
+#endif
+        is.close();
+        started = true;
+        poll_warp->reset();
+        SIMLOG("Restored checkpoint @ cycle %lu (instret: %lu)\n", tb->get_cycles(), instret);
+        return true;
+#else
+        SIMERR("Checkpoints are not supported by this build (SAVABLE=0)\n");
+        return false;
+#endif
+    }
+
+    void open_trace(const std::string &filename) {
+        // Open the trace file
+        SIMLOG("Opening trace file: %s\n", filename.c_str());
+        tb->open_trace(filename);
+    }
+
+    void set_fast_tick(bool en) {
+        // Use the fast-clock path in the testbench
+        if(en) {
+            SIMLOG("Using fast-clock path\n");
+        }
+        tb->set_fast_tick(en);
+    }
+
+    bool load_program(const std::string &filename) {
+        // Load an ELF, raw binary (.bin, at the reset address) or hex program
+        // file, then the file mappings and the data images
+        bool ok;
+        if(ElfLoader::is_elf(filename)) {
+            ok = load_elf(filename);
+        }
+        else if(filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".bin") == 0) {
+            ok = load_bin(filename, MEM_ADDR);
+        }
+        else {
+            ok = load_hex(filename);
+        }
+        roms.clear();
+#ifdef SIM_MEM_SPARSE
+        mem_model.clear_roms();
+#endif
+        for(auto &m: mappings) {
+            ok = ok && map_file(m.file, m.addr, m.ro);
+        }
+        for(auto &img: data_images) {
+            ok = ok && load_bin(img.first, img.second);
+        }
+        return ok;
+    }
+
+    bool map_file(const std::string &filename, uint32_t addr, bool ro) {
+        // Map a host file into memory at addr (sparse memory builds), or copy
+        // it (read-only is then not enforced)
+        SIMLOG("Mapping file: %s @ 0x%08x%s\n", filename.c_str(), addr, ro ? " (read-only)" : "");
+        struct stat st;
+        if(stat(filename.c_str(), &st) != 0) {
+            fprintf(stderr, "Error: Could not open file: %s\n", filename.c_str());
+            return false;
+        }
+        if(addr < MEM_ADDR || (uint64_t)addr + st.st_size > (uint64_t)MEM_ADDR + MEM_SIZE) {
+            fprintf(stderr, "Error: Mapping out of range: 0x%08x-0x%08lx\n", addr, (uint64_t)addr + st.st_size);
+            return false;
+        }
+#ifdef SIM_MEM_SPARSE
+        if((addr - MEM_ADDR) % GuestMem::PAGE_BYTES) {
+            fprintf(stderr, "Error: Mapping address must be %lu byte aligned: 0x%08x\n", GuestMem::PAGE_BYTES, addr);
+            return false;
+        }
+        if(!guest_mem.map_file(filename, addr - MEM_ADDR, st.st_size)) {
+            fprintf(stderr, "Error: Could not map file: %s: %s\n", filename.c_str(), strerror(errno));
+            return false;
+        }
+        if(ro) {
+            // Stores are dropped, by the RTL memory and the ISS alike
+            roms.push_back({addr, (uint32_t)(st.st_size + 3) & ~3u});
+            mem_model.add_rom((addr - MEM_ADDR) / 4, (st.st_size + 3) / 4);
+        }
+        return true;
+#else
+        if(ro) {
+            SIMWARN("Read-only mappings need a sparse memory build (MEM_MODEL=sparse), %s is writable\n", filename.c_str());
+        }
+        return load_bin(filename, addr);
+#endif
+    }
+
+    void add_mapping(const std::string &filename, uint32_t addr, bool ro) {
+        // File mapped after every program
+        mappings.push_back({filename, addr, ro});
+    }
+
+    bool load_elf(const std::string &filename) {
+        // Copy the PT_LOAD segments of an ELF file into memory
+        SIMLOG("Loading ELF file: %s\n", filename.c_str());
+        ElfLoader elf;
+        if(!elf.read(filename)) {
+            fprintf(stderr, "Error: %s: %s\n", filename.c_str(), elf.get_error().c_str());
+            return false;
+        }
+
+        uint8_t *mem = (uint8_t *)mem_base;
+        uint64_t nbytes_written = 0;
+        for(auto &seg: elf.get_segments()) {
+            if(seg.addr < MEM_ADDR || (uint64_t)seg.addr + seg.memsz > (uint64_t)MEM_ADDR + MEM_SIZE) {
+                fprintf(stderr, "Error: Segment out of range: 0x%08x-0x%08x\n", seg.addr, seg.addr + seg.memsz);
+                return false;
+            }
+            memcpy(mem + (seg.addr - MEM_ADDR), seg.data, seg.filesz);
+            memset(mem + (seg.addr - MEM_ADDR) + seg.filesz, 0, seg.memsz - seg.filesz);
+            nbytes_written += seg.memsz;
+        }
+        if(elf.get_entry() != MEM_ADDR) {
+            SIMWARN("ELF entry point (0x%08x) is not the reset address (0x%08x)\n", elf.get_entry(), MEM_ADDR);
+        }
+        symbols = elf.get_symbols();
+        SIMLOG("Loaded %lu bytes in memory (%lu segments, %lu symbols)\n", nbytes_written, elf.get_segments().size(), symbols.size());
+        return true;
+    }
+
+    bool get_symbol(const std::string &name, uint32_t &addr) {
+        // Look up a symbol of the loaded ELF file
+        auto it = symbols.find(name);
+        if(it == symbols.end()) {
+            return false;
+        }
+        addr = it->second;
+        return true;
+    }
+
+    bool load_hex(const std::string &filename) {
+        // Load a $readmemh style hex file: whitespace separated words, "//"
+        // comments and "@<word index>" records that move the load address
+        SIMLOG("Loading hex file: %s\n", filename.c_str());
+        std::ifstream hex_file(filename, std::ios::binary | std::ios::ate);
+        if(!hex_file.is_open()) {
+            fprintf(stderr, "Error: Could not open hex file: %s\n", filename.c_str());
+            return false;
+        }
+        std::vector<char> buf(hex_file.tellg());
+        hex_file.seekg(0);
+        hex_file.read(buf.data(), buf.size());
+        buf.push_back('\0');
+
+        uint32_t *mem = mem_base;
+        const char *p = buf.data();
+        uint32_t index = 0;                 // Word index, local to memory
+        uint64_t nbytes_written = 0;
+        unsigned line = 1;
+
+        while(*p) {
+            if(*p == '\n') {
+                line++;
+                p++;
+                continue;
+            }
+            if(isspace((unsigned char)*p)) {
+                p++;
+                continue;
+            }
+            if(p[0] == '/' && p[1] == '/') {
+                while(*p && *p != '\n') p++;
+                continue;
+            }
+
+            // Address record or data word
+            bool is_addr = *p == '@';
+            if(is_addr) p++;
+            char *end;
+            errno = 0;
+            unsigned long v = strtoul(p, &end, 16);
+            if(end == p || (*end && !isspace((unsigned char)*end))) {
+                fprintf(stderr, "Error: %s:%u: Invalid hex %s\n", filename.c_str(), line, is_addr ? "address" : "data");
+                return false;
+            }
+            p = end;
+
+            if(is_addr) {
+                // Checked here, as the word index must not wrap when stored
+                if(errno == ERANGE || v >= MEM_SIZE / 4) {
+                    fprintf(stderr, "Error: %s:%u: Word index out of range: @%lx\n", filename.c_str(), line, v);
+                    return false;
+                }
+                index = v;
+                continue;
+            }
+            if(errno == ERANGE || v > UINT32_MAX) {
+                fprintf(stderr, "Error: %s:%u: Data wider than 32 bits\n", filename.c_str(), line);
+                return false;
+            }
+            if(index >= MEM_SIZE / 4) {
+                fprintf(stderr, "Error: %s:%u: Address out of range: 0x%08x\n", filename.c_str(), line, MEM_ADDR + index * 4);
+                return false;
+            }
+            mem[index++] = v;
+            nbytes_written += 4;
+        }
+
+        SIMLOG("Loaded %lu bytes in memory\n", nbytes_written);
+        return true;
+    }
+
+    bool load_bin(const std::string &filename, uint32_t addr) {
+        // Copy a raw binary image into memory at addr
+        SIMLOG("Loading binary file: %s @ 0x%08x\n", filename.c_str(), addr);
+        FILE *f = fopen(filename.c_str(), "rb");
+        if(!f) {
+            fprintf(stderr, "Error: Could not open binary file: %s\n", filename.c_str());
+            return false;
+        }
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+
+        // Validate the whole range once, then read straight into memory
+        if(size < 0 || addr < MEM_ADDR || (uint64_t)addr + size > (uint64_t)MEM_ADDR + MEM_SIZE) {
+            fprintf(stderr, "Error: Image out of range: 0x%08x-0x%08lx\n", addr, (uint64_t)addr + size);
+            fclose(f);
+            return false;
+        }
+        uint8_t *mem = (uint8_t *)mem_base;
+        size_t nread = fread(mem + (addr - MEM_ADDR), 1, size, f);
+        fclose(f);
+        if(nread != (size_t)size) {
+            fprintf(stderr, "Error: Could not read binary file: %s\n", filename.c_str());
+            return false;
+        }
+        SIMLOG("Loaded %lu bytes in memory\n", nread);
+        return true;
+    }
+
+    void set_mem_timing(unsigned port, const MemTiming_t &t) {
+        // Latency/jitter of a port of the DPI memory
+        SIMLOG("%s timing: read latency: %u, write latency: %u, jitter: %u\n", port == MemModel::PORT_IMEM ? "IMEM" : "DMEM",
+            t.rlat, t.wlat, t.jitter);
+        mem_model.set_timing(port, t);
+    }
+
+    void set_mem_bandwidth(unsigned bytes_per_cycle, uint64_t seed) {
+        // Shared bandwidth limit and jitter seed of the DPI memory
+        if(bytes_per_cycle) {
+            SIMLOG("Memory bandwidth: %u B/cycle\n", bytes_per_cycle);
+        }
+        mem_model.set_bandwidth(bytes_per_cycle);
+        mem_model.set_seed(seed);
+    }
+
+    void add_data_image(const std::string &filename, uint32_t addr) {
+        // Raw binary image loaded after every program
+        data_images.push_back({filename, addr});
+    }
+
+    void dump_mem(std::string filename) {
+        SIMLOG("Dumping memory to file: %s\n", filename.c_str());
+        std::ofstream dump_file(filename, std::ios::binary);
+        if(!dump_file.is_open()) {
+            fprintf(stderr, "Error: Could not open dump file: %s\n", filename.c_str());
+            return;
+        }
+#ifdef SIM_MEM_SPARSE
+        // Non-zero pages only, each after an @<word index> record
+        GuestMem::Pages_t pages;
+        GuestMem::save_pages(mem_base, MEM_SIZE, pages);
+        for(auto &page: pages) {
+            dump_file << "@" << std::hex << page.offset / 4 << "\n";
+            for(size_t i = 0; i < page.data.size(); i += 4) {
+                uint32_t data;
+                memcpy(&data, &page.data[i], 4);
+                dump_file << std::hex << std::setw(8) << std::setfill('0') << data << "\n";
+            }
+        }
+#else
+        for(uint32_t word_indx = 0; word_indx < MEM_SIZE / 4; word_indx++) {
+            uint32_t data = mem_base[word_indx];
+            dump_file << std::hex << std::setw(8) << std::setfill('0') << data << "\n";
+        }
+#endif
+        dump_file.close();
+    }
+
+    bool write_mem_word(uint32_t addr, uint32_t data) {
+        // Write a word to the memory (addr must be word aligned)
+        if(addr < MEM_ADDR || addr >= MEM_ADDR + MEM_SIZE || (addr & 0x3)) {
+            fprintf(stderr, "Error: Invalid memory word address: 0x%08x\n", addr);
+            return false;
+        }
+        mem_base[(addr - MEM_ADDR) / 4] = data;
+        return true;
+    }
+
+    void clear_mem() {
+        // Clear the whole memory
+#ifdef SIM_MEM_SPARSE
+        guest_mem.clear();
+#else
+        memset(mem_base, 0, MEM_SIZE);
+#endif
+    }
+
+    void reset_state() {
+        // Clear the simulator state and memory so that the model can be reused
+        // for another program (the SoC itself is reset by run())
+        instret     = 0;
+        term_req    = false;
+        term_pc     = 0;
+        term_cause  = TERM_CAUSE_UNKNOWN;
+        sw_ret_code = 0;
+        ff_instret  = 0;
+        ff_cycles   = 0;
+        idle_cycles = 0;
+        poll_warp->reset();
+        roi_started = false;
+        started     = false;
+        delete cosim_ref;
+        cosim_ref   = nullptr;
+        tb->clear_finished();
+        clear_mem();
+        mem_model.reset_stats();
+        for(auto &range: mmio_bus.get_ranges()) {
+            range.dev->reset();
+        }
+    }
+
+    // Query simulation results
+    Term_cause_t get_term_cause() { return term_cause; }
+    uint64_t get_cycles() { return tb->get_cycles(); }
+    uint64_t get_instret() { return instret; }
+    bool     has_roi() { return roi_started; }
+    uint64_t get_roi_cycles() { return tb->get_cycles() - roi_start_cycles; }
+    uint64_t get_roi_instret() { return instret - roi_start_instret_actual; }
+    uint64_t get_max_cycles() { return max_cycles; }
+
+    void set_max_cycles(uint64_t cycles) {
+        // Set the maximum number of cycles
+        SIMLOG("Setting maximum cycles to: %lu\n", cycles);
+        max_cycles = cycles;
+    }
+
+    void sim_log() {
+        if(cosim_ref && (*signal_ptrs.instr_valid & 0x1)) {
+            cosim_check();
+        }
+
+        // Hand the retire record to the consumers (log writers, profilers)
+        if(!commit_stream.is_running() || !((*signal_ptrs.instr_valid & 0x1) || log_bubbles)) {
+            return;
+        }
+        Commit_t &c = commit_stream.next();
+        c.cycle     = tb->get_cycles();
+        c.valid     = *signal_ptrs.instr_valid & 0x1;
+        c.pc        = *signal_ptrs.pc;
+        c.instr     = *signal_ptrs.instr;
+        c.rd_s      = *signal_ptrs.rd_s & 0x1f;
+        c.rd_v      = *signal_ptrs.rd_v;
+        c.rd_we     = *signal_ptrs.rd_we & 0x1;
+        c.rs1_s     = *signal_ptrs.rs1_s & 0x1f;
+        c.rs1_v     = *signal_ptrs.rs1_v;
+        c.rs2_s     = *signal_ptrs.rs2_s & 0x1f;
+        c.rs2_v     = *signal_ptrs.rs2_v;
+        c.mem_addr  = *signal_ptrs.mem_addr;
+        c.mem_rmask = *signal_ptrs.mem_rmask & 0xf;
+        c.mem_wmask = *signal_ptrs.mem_wmask & 0xf;
+        c.mem_rdata = *signal_ptrs.mem_rdata;
+        c.mem_wdata = *signal_ptrs.mem_wdata;
+        commit_stream.publish();
+    }
+
+    void start_commit_stream() {
+        // Attach the log writer and the BBV profiler to the commit stream, they
+        // run on their own threads from now on
+        if(commit_stream.is_running()) {
+            return;
+        }
+        if(log_w.is_open()) {
+            LogWriter::set_threaded();
+            if(log_format == "bin") {
+                bin_log.open(&log_w);
+                commit_stream.add(&bin_log);
+            } else {
+                text_log = new TextLog(&log_w, log_format == "spike");
+                commit_stream.add(text_log);
+            }
+            log_bubbles = log_format != "spike";
+        }
+        if(bbv) {
+            commit_stream.add(bbv);
+        }
+        commit_stream.start();
+    }
+
+    void open_log(const std::string &filename) {
+        // Open the simulation log file
+        SIMLOG("Opening simulation log file: %s\n", filename.c_str());
+        if(!log_w.open(filename, flush_policy)) {
+            fprintf(stderr, "Error: Could not open sim log file: %s\n", filename.c_str());
+            return;
+        }
+    }
+
+    void set_flush_policy(FlushPolicy_t policy) {
+        // When the log and trace buffers are written (before opening them)
+        flush_policy = policy;
+        tb->set_trace_flush(policy);
+    }
+
+    void set_log_format(const std::string &format) {
+        // Set the log format
+        SIMLOG("Setting log format to: %s\n", format.c_str());
+        if(format == "spike") {
+            log_format = "spike";
+        } else if(format == "bin") {
+            log_format = "bin";
+        } else if(format == "default") {
+            log_format = "default";
+        } else {
+            fprintf(stderr, "Error: Unknown log format: %s\n", format.c_str());
+            return;
+        }
+    }
+
+private:
+    Testbench<Vorion_soc> *tb;
+    uint64_t max_cycles = SIM_MAX_CYCLES;
+
+    // Retired instruction counter
+    uint64_t instret = 0;
+
+    // Enabled features
+    bool en_vdev    = true;
+    bool en_instret = true;
+    bool en_console = true;
+    bool en_idle_skip = true;
+    bool en_poll_warp = false;
+
+    // Cycles skipped while the core slept in WFI
+    uint64_t idle_cycles = 0;
+
+    // Busy-wait time warp (loops polling the VDEV cycle counter)
+    PollWarp *poll_warp = nullptr;
+
+    // Checkpoints
+    uint64_t    save_ckpt_at = UINT64_MAX;  // Cycle to save a checkpoint at
+    std::string ckpt_file;                  // File to save the checkpoint to
+
+    // Instruction limit and region of interest
+    uint64_t max_instret       = UINT64_MAX;
+    uint64_t stop_instret      = UINT64_MAX;    // Current run_loop segment stops here
+    uint64_t roi_start_instret = UINT64_MAX;
+    uint64_t roi_start_instret_actual = 0;
+    uint64_t roi_start_cycles  = 0;
+    bool     roi_started       = false;
+
+    // Basic block vector profiler
+    Bbv *bbv = nullptr;
+
+    // Instructions to execute on the ISS before switching to RTL
+    uint64_t ff_ninstrs = 0;
+    uint64_t ff_instret = 0;        // Instructions executed by the ISS
+    uint64_t ff_cycles  = 0;        // Cycles counted by the ISS (IssClint)
+    Iss      *ff_iss    = nullptr;  // ISS while fast-forwarding
+    IssClint *ff_clint  = nullptr;
+
+    // Co-simulation reference model
+    bool                  en_cosim   = false;
+    Iss                  *cosim_ref  = nullptr;
+    CosimMmio            *cosim_mmio = nullptr;
+    GuestMem              cosim_mem;
+
+    // Symbols of the loaded ELF file
+    std::map<std::string, uint32_t> symbols;
+
+    // Raw binary images (file, address) loaded after the program
+    std::vector<std::pair<std::string, uint32_t>> data_images;
+
+    // Guest console output
+    Console console;
+
+    // Devices on the dmem port
+    MmioBus mmio_bus;
+    Vdev    vdev;
+    BlkDev  blkdev;
+
+    // Host files mapped after the program, read-only ranges (addr, size)
+    std::vector<Mapping_t> mappings;
+    std::vector<std::pair<uint32_t, uint32_t>> roms;
+
+    // Timing model of the DPI memory (MEM_MODEL=dpi/sparse builds)
+    MemModel mem_model;
+
+    // Memory words: sparse guest memory (MEM_MODEL=sparse builds) or the
+    // verilated memory array
+    GuestMem  guest_mem;
+    uint32_t *mem_base = nullptr;
+
+    // Snapshot to start from instead of the reset state
+    const ArchState_t *start_state = nullptr;
+
+    // SoC is out of reset (restored checkpoint or snapshot point): run() continues
+    bool started = false;
+    
+    // Simulation control
+    bool         term_req    = false;
+    uint32_t     term_pc     = 0;
+    Term_cause_t term_cause  = TERM_CAUSE_UNKNOWN;
+    int          sw_ret_code = 0;
 
     // Signal pointers
     struct {
@@ -457,13 +1879,842 @@ private:
         uint8_t *mem_wmask;
         uint32_t *mem_rdata;
         uint32_t *mem_wdata;
+        bool *dmem_valid;       // dmem port (request of the current cycle)
+        uint32_t *dmem_addr;
+        bool *dmem_we;
+        bool *st_commit;        // Store retiring at the next edge
+        uint32_t *st_commit_addr;
+        uint32_t *st_commit_wdata;
+        uint8_t *st_commit_mask;
+        bool *sleep;            // Core sleeps in WFI (pipeline drained)
+        uint32_t *dmem_pc;      // PC of the dmem request
     } signal_ptrs;
 
-    FILE *log_f = nullptr;
-    std::string log_format = "default";
+    LogWriter log_w;
+    FlushPolicy_t flush_policy = FLUSH_INTERVAL;
+    std::string log_format = "default";
+    BinLog bin_log;
+    TextLog *text_log = nullptr;
+    bool log_bubbles = false;       // Log the cycles without a retired instruction
+
+    // Retire records for the log writers and profilers
+    CommitStream commit_stream;
+};
+
+
+
+// Type of parsed optional arguments
+typedef std::map<std::string, ArgParse::ArgVal_t> OptArgs_t;
+
+// Parse a list of data images: FILE@ADDR[,FILE@ADDR...]
+bool parse_data_images(const std::string &arg, std::vector<std::pair<std::string, uint32_t>> &images) {
+    std::stringstream ss(arg);
+    std::string item;
+    while(std::getline(ss, item, ',')) {
+        size_t at = item.rfind('@');
+        char *end = nullptr;
+        unsigned long addr = at != std::string::npos && at > 0 ? strtoul(item.c_str() + at + 1, &end, 0) : 0;
+        if(!end || end == item.c_str() + at + 1 || *end) {
+            fprintf(stderr, "Error: Invalid data image (expected FILE@ADDR): %s\n", item.c_str());
+            return false;
+        }
+        images.push_back({item.substr(0, at), (uint32_t)addr});
+    }
+    return true;
+}
+
+// Parse a memory port timing: key=value[,key=value...] with keys lat (read
+// and write), rlat, wlat and jitter
+bool parse_mem_timing(const std::string &arg, MemTiming_t &t) {
+    std::stringstream ss(arg);
+    std::string item;
+    while(std::getline(ss, item, ',')) {
+        size_t eq = item.find('=');
+        char *end = nullptr;
+        unsigned long v = eq != std::string::npos ? strtoul(item.c_str() + eq + 1, &end, 0) : 0;
+        if(!end || end == item.c_str() + eq + 1 || *end) {
+            fprintf(stderr, "Error: Invalid memory timing (expected key=value): %s\n", item.c_str());
+            return false;
+        }
+        std::string key = item.substr(0, eq);
+        if(key == "lat") {
+            t.rlat = t.wlat = v;
+        }
+        else if(key == "rlat") {
+            t.rlat = v;
+        }
+        else if(key == "wlat") {
+            t.wlat = v;
+        }
+        else if(key == "jitter") {
+            t.jitter = v;
+        }
+        else {
+            fprintf(stderr, "Error: Unknown memory timing key (lat, rlat, wlat, jitter): %s\n", key.c_str());
+            return false;
+        }
+    }
+    if(t.rlat == 0 || t.wlat == 0) {
+        fprintf(stderr, "Error: Memory latency must be at least 1 cycle: %s\n", arg.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Parse a list of file mappings: FILE@ADDR[:ro][,FILE@ADDR[:ro]...]
+bool parse_mappings(const std::string &arg, std::vector<Mapping_t> &maps) {
+    std::stringstream ss(arg);
+    std::string item;
+    while(std::getline(ss, item, ',')) {
+        bool ro = item.size() > 3 && item.compare(item.size() - 3, 3, ":ro") == 0;
+        if(ro) {
+            item.resize(item.size() - 3);
+        }
+        std::vector<std::pair<std::string, uint32_t>> image;
+        if(!parse_data_images(item, image)) {
+            return false;
+        }
+        maps.push_back({image[0].first, image[0].second, ro});
+    }
+    return true;
+}
+
+// Add the raw binary data images and file mappings (validated in main) to a
+// simulator instance
+void add_data_images(OrionSim &sim, OptArgs_t &opt_args) {
+    if(opt_args.count("map") > 0) {
+        std::vector<Mapping_t> maps;
+        parse_mappings(opt_args["map"].value.as_str, maps);
+        for(auto &m: maps) {
+            sim.add_mapping(m.file, m.addr, m.ro);
+        }
+    }
+    if(opt_args.count("load_bin") > 0) {
+        std::vector<std::pair<std::string, uint32_t>> images;
+        parse_data_images(opt_args["load_bin"].value.as_str, images);
+        for(auto &img: images) {
+            sim.add_data_image(img.first, img.second);
+        }
+    }
+}
+
+// Apply the run options shared by all programs to a simulator instance,
+// returns false if the simulator could not be set up
+bool configure_sim(OrionSim &sim, OptArgs_t &opt_args) {
+    add_data_images(sim, opt_args);
+
+    // DPI memory timing (validated in main)
+    MemTiming_t timing;
+    if(opt_args.count("imem_timing") > 0 && parse_mem_timing(opt_args["imem_timing"].value.as_str, timing)) {
+        sim.set_mem_timing(MemModel::PORT_IMEM, timing);
+    }
+    timing = MemTiming_t();
+    if(opt_args.count("dmem_timing") > 0 && parse_mem_timing(opt_args["dmem_timing"].value.as_str, timing)) {
+        sim.set_mem_timing(MemModel::PORT_DMEM, timing);
+    }
+    sim.set_mem_bandwidth(opt_args.count("mem_bw") > 0 ? opt_args["mem_bw"].value.as_int : 0, opt_args["mem_seed"].value.as_int);
+
+    // Block device (validated in main)
+    if(opt_args.count("blk") > 0 && !sim.open_blkdev(opt_args["blk"].value.as_str, opt_args["blk_latency"].value.as_int)) {
+        return false;
+    }
+
+    // Use the fast-clock path for untraced and unlogged runs
+    if(!opt_args["trace"].value.as_bool) {
+        sim.set_fast_tick(opt_args["fast_tick"].value.as_bool || opt_args.count("log") == 0);
+    }
+
+    // Disable VDEV/instret counting
+    if(opt_args["no_vdev"].value.as_bool) {
+        sim.set_vdev(false);
+    }
+    if(opt_args["no_instret"].value.as_bool) {
+        sim.set_instret(false);
+    }
+    if(opt_args["no_idle_skip"].value.as_bool) {
+        sim.set_idle_skip(false);
+    }
+    if(opt_args["poll_warp"].value.as_bool) {
+        sim.set_poll_warp(true);
+    }
+
+    // Execute the first instructions on the ISS
+    if(opt_args.count("fast_forward") > 0) {
+        sim.set_fast_forward(opt_args["fast_forward"].value.as_int);
+    }
+
+    // Lockstep co-simulation
+    if(opt_args["cosim"].value.as_bool && !sim.set_cosim(true)) {
+        return false;
+    }
+
+    // Instruction limit and region of interest
+    if(opt_args.count("max_instret") > 0) {
+        sim.set_max_instret(opt_args["max_instret"].value.as_int);
+    }
+    if(opt_args.count("roi_start") > 0) {
+        sim.set_roi_start(opt_args["roi_start"].value.as_int);
+    }
+
+    // Set maximum cycles
+    if(opt_args.count("max_cycles") > 0) {
+        uint64_t max_cycles = (uint64_t) opt_args["max_cycles"].value.as_int;
+        sim.set_max_cycles(max_cycles);
+    }
+    return true;
+}
+
+// Get the number of simulation threads per model
+unsigned get_nthreads(OptArgs_t &opt_args) {
+    return opt_args.count("threads") > 0 ? opt_args["threads"].value.as_int : SIM_THREADS;
+}
+
+// Interrupt signals, taken by the signal thread
+void get_stop_signals(sigset_t &set) {
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGHUP);
+}
+
+// After an interrupted run shut down: die of the signal, as the caller expects
+static void reraise_stop_signal() {
+    int sig = stop_signal.load();
+    if(sig) {
+        fflush(stdout);
+        fflush(stderr);
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, sig);
+        pthread_sigmask(SIG_UNBLOCK, &set, nullptr);
+        raise(sig);
+    }
+}
+
+// Take SIGINT, SIGTERM and SIGHUP on a dedicated thread instead of in a
+// handler: the first one asks the simulations to stop (stop_signal), so that
+// the commit stream consumers, logs, traces and the console are shut down by
+// their owners, a second one kills the process right away. Must be called
+// before any other thread is created, they inherit the blocked signals.
+void start_signal_thread() {
+    sigset_t set;
+    get_stop_signals(set);
+    pthread_sigmask(SIG_BLOCK, &set, nullptr);
+    atexit(reraise_stop_signal);
+    std::thread([set]() {
+        int sig;
+        if(sigwait(&set, &sig) != 0) {
+            return;
+        }
+        stop_signal = sig;
+        if(sigwait(&set, &sig) != 0) {
+            return;
+        }
+        pthread_sigmask(SIG_UNBLOCK, &set, nullptr);
+        raise(sig);
+    }).detach();
+}
+
+// Simulate one program file with its own OrionSim instance
+int run_program(OptArgs_t opt_args, const std::string &prog_file) {
+    // Create the simulator instance
+    OrionSim sim(get_nthreads(opt_args));
+    if(!sim.is_ready()) {
+        return 1;
+    }
+
+    // Flush policy of the trace and log files (validated in main)
+    FlushPolicy_t flush_policy;
+    if(parse_flush_policy(opt_args["flush_policy"].value.as_str, flush_policy)) {
+        sim.set_flush_policy(flush_policy);
+    }
+
+    // Open trace file
+    if(opt_args["trace"].value.as_bool) {
+        std::string trace_file = opt_args["trace_file"].value.as_str;
+        sim.open_trace(trace_file);
+    }
+
+    // Enable simulation log
+    if(opt_args.count("log") > 0) {
+        std::string log_file = opt_args["log"].value.as_str;
+        sim.open_log(log_file);
+    }
+
+    // Set log format
+    if(opt_args.count("log_format") > 0) {
+        std::string log_format = opt_args["log_format"].value.as_str;
+        sim.set_log_format(log_format);
+    }  
+
+    if(!configure_sim(sim, opt_args)) {
+        return 1;
+    }
+
+    // Profile basic block vectors
+    if(opt_args.count("bbv") > 0) {
+        if(!sim.open_bbv(opt_args["bbv"].value.as_str, opt_args["bbv_interval"].value.as_int)) {
+            return 1;
+        }
+    }
+
+    // Save a checkpoint on the way
+    if(opt_args.count("save_checkpoint_at") > 0) {
+        sim.set_save_checkpoint(opt_args["save_checkpoint_at"].value.as_int, opt_args["checkpoint_file"].value.as_str);
+    }
+
+    // Load the program file or restore a checkpoint
+    if(opt_args.count("restore_checkpoint") > 0) {
+        if(!prog_file.empty()) {
+            SIMWARN("Program file ignored, memory is restored from the checkpoint\n");
+        }
+        if(!sim.restore_checkpoint(opt_args["restore_checkpoint"].value.as_str)) {
+            return 1;
+        }
+    }
+    else if(!sim.load_program(prog_file)) {
+        return 1;
+    }
+
+    // Run the simulation
+    int rv = sim.run();
+
+    // Dump memory contents to a file
+    if(opt_args.count("dump_mem") > 0) {
+        std::string dump_file = opt_args["dump_mem"].value.as_str;
+        sim.dump_mem(dump_file);
+    }
+
+    return rv;
+}
+
+// Simulate several program files concurrently, one OrionSim instance per
+// program, on a pool of njobs threads
+int run_programs(const OptArgs_t &opt_args, const std::vector<std::string> &prog_files, unsigned njobs) {
+    std::vector<int> rvs(prog_files.size(), 0);
+    std::atomic<size_t> next_prog(0);
+
+    std::vector<std::thread> workers;
+    for(unsigned j = 0; j < njobs; j++) {
+        workers.emplace_back([&]() {
+            size_t i;
+            while((i = next_prog++) < prog_files.size()) {
+                rvs[i] = run_program(opt_args, prog_files[i]);
+            }
+        });
+    }
+    for(auto &w: workers) {
+        w.join();
+    }
+
+    // Report
+    int nfailed = 0;
+    if(verbosity > NONE) {
+        printf("----------------------------------------\n");
+    }
+    for(size_t i = 0; i < prog_files.size(); i++) {
+        if(verbosity > NONE) {
+            printf("%s  retcode: %-3d  %s\n", rvs[i] == 0 ? "PASS" : "FAIL", rvs[i], prog_files[i].c_str());
+        }
+        nfailed += rvs[i] != 0;
+    }
+    if(verbosity > NONE) {
+        printf("----------------------------------------\n");
+        printf("Passed: %lu, Failed: %d\n", prog_files.size() - nfailed, nfailed);
+    }
+    return nfailed > 0 ? 1 : 0;
+}
+
+// Batch manifest entry
+struct BatchEntry_t {
+    std::string prog_file;
+    uint64_t    max_cycles;
+    int         exp_retcode;
+    std::string blk_file;       // Block device image, empty: --blk
+};
+
+// Parse a batch manifest; each line holds one entry:
+//   <program-file> [max-cycles] [expected-retcode] [blk=<image-file>]
+// Empty lines and lines starting with '#' are ignored.
+bool parse_batch_manifest(const std::string &filename, uint64_t default_max_cycles, std::vector<BatchEntry_t> &entries) {
+    std::ifstream manifest(filename);
+    if(!manifest.is_open()) {
+        fprintf(stderr, "Error: Could not open batch manifest: %s\n", filename.c_str());
+        return false;
+    }
+
+    std::string line;
+    unsigned lineno = 0;
+    while(std::getline(manifest, line)) {
+        lineno++;
+        std::istringstream fields(line);
+        std::string prog_file, max_cycles_s, retcode_s, field;
+        if(!(fields >> prog_file) || prog_file[0] == '#') {
+            continue;
+        }
+
+        BatchEntry_t entry = {prog_file, default_max_cycles, 0, ""};
+        while(fields >> field) {
+            if(field.compare(0, 4, "blk=") == 0 && field.size() > 4) {
+                entry.blk_file = field.substr(4);
+            }
+            else if(max_cycles_s.empty()) {
+                max_cycles_s = field;
+            }
+            else if(retcode_s.empty()) {
+                retcode_s = field;
+            }
+            else {
+                fprintf(stderr, "Error: %s:%u: Unexpected field: %s\n", filename.c_str(), lineno, field.c_str());
+                return false;
+            }
+        }
+        char *end = nullptr;
+        if(!max_cycles_s.empty()) {
+            entry.max_cycles = strtoull(max_cycles_s.c_str(), &end, 0);
+            if(*end != '\0') {
+                fprintf(stderr, "Error: %s:%u: Invalid max-cycles: %s\n", filename.c_str(), lineno, max_cycles_s.c_str());
+                return false;
+            }
+        }
+        if(!retcode_s.empty()) {
+            entry.exp_retcode = strtol(retcode_s.c_str(), &end, 0);
+            if(*end != '\0') {
+                fprintf(stderr, "Error: %s:%u: Invalid expected retcode: %s\n", filename.c_str(), lineno, retcode_s.c_str());
+                return false;
+            }
+        }
+        entries.push_back(entry);
+    }
+    return true;
+}
+
+// Simulate all batch entries; each of the njobs workers creates one model and
+// reuses it (reset, clear memory, reload) for every entry it picks up.
+int run_batch(const OptArgs_t &opt_args, const std::vector<BatchEntry_t> &entries, unsigned njobs) {
+    std::atomic<size_t> next_entry(0);
+    std::atomic<int> nfailed(0);
+    std::atomic<bool> config_failed(false);
+
+    std::vector<std::thread> workers;
+    for(unsigned j = 0; j < njobs; j++) {
+        workers.emplace_back([&]() {
+            OptArgs_t args = opt_args;
+            OrionSim sim(get_nthreads(args));
+            if(!sim.is_ready() || !configure_sim(sim, args)) {
+                config_failed = true;
+                return;
+            }
+
+            // Block device of the entry, the one of --blk unless it names its own
+            std::string default_blk = args.count("blk") > 0 ? args["blk"].value.as_str : "";
+            std::string open_blk = default_blk;
+
+            size_t i;
+            while((i = next_entry++) < entries.size()) {
+                const BatchEntry_t &e = entries[i];
+                sim.reset_state();
+                sim.set_max_cycles(e.max_cycles);
+                const std::string &blk = e.blk_file.empty() ? default_blk : e.blk_file;
+                bool ok = true;
+                if(blk != open_blk) {
+                    sim.close_blkdev();
+                    open_blk.clear();
+                    if(!blk.empty()) {
+                        ok = sim.open_blkdev(blk, args["blk_latency"].value.as_int);
+                        open_blk = ok ? blk : "";
+                    }
+                }
+                int rv = ok && sim.load_program(e.prog_file) ? sim.run() : -1;
+
+                bool pass = sim.get_term_cause() == TERM_CAUSE_TERM_REQ && rv == e.exp_retcode;
+                nfailed += !pass;
+                if(verbosity > NONE) {
+                    printf("[batch] %s  retcode: %-3d (expected: %d)  cycles: %lu  instret: %lu%s  %s\n",
+                        pass ? "PASS" : "FAIL", rv, e.exp_retcode, sim.get_cycles(), sim.get_instret(),
+                        sim.get_term_cause() == TERM_CAUSE_MAX_CYCLES ? " (max cycles reached)" : "", e.prog_file.c_str());
+                }
+            }
+        });
+    }
+    for(auto &w: workers) {
+        w.join();
+    }
+    if(config_failed) {
+        return 1;
+    }
+
+    if(verbosity > NONE) {
+        printf("[batch] Passed: %lu, Failed: %d\n", entries.size() - nfailed, (int)nfailed);
+    }
+    return nfailed > 0 ? 1 : 0;
+}
+
+// Split the program into nintervals instruction intervals and simulate them
+// concurrently, one model per job. The ISS counts the instructions of the
+// program and snapshots the architectural state warmup instructions before
+// each interval; each interval is then simulated in RTL from its snapshot
+// (warm-up first, then the measured interval). max_cycles bounds the RTL cycles
+// of each interval. With compare, a serial RTL run of the whole program is
+// simulated as one more job and compared with the stitched result.
+int run_intervals(OptArgs_t opt_args, const std::string &prog_file, unsigned nintervals, uint64_t warmup, bool compare, unsigned njobs) {
+    uint64_t max_cycles = opt_args.count("max_cycles") > 0 ? opt_args["max_cycles"].value.as_int : SIM_MAX_CYCLES;
+    uint64_t max_instrs = opt_args.count("max_instret") > 0 ? opt_args["max_instret"].value.as_int : max_cycles;
+
+    // Count the instructions and take the snapshots on the ISS
+    std::vector<ArchState_t> states;
+    uint64_t ninstrs, interval_len;
+    std::vector<uint64_t> points;
+    {
+        OrionSim sim(1);
+        if(!sim.is_ready()) {
+            return 1;
+        }
+        sim.set_console(false);
+        add_data_images(sim, opt_args);
+        if(!sim.load_program(prog_file)) {
+            return 1;
+        }
+        ninstrs = sim.take_arch_states({}, states, max_instrs);
+        interval_len = (ninstrs + nintervals - 1) / nintervals;
+        if(ninstrs == 0) {
+            SIMERR("Program executed no instructions on the ISS\n");
+            return 1;
+        }
+        for(unsigned i = 0; i < nintervals; i++) {
+            uint64_t start = i * interval_len;
+            points.push_back(start > warmup ? start - warmup : 0);
+        }
+
+        sim.reset_state();
+        sim.load_program(prog_file);
+        sim.take_arch_states(points, states, 0);
+        SIMLOG("Program: %lu instructions, %u intervals of %lu instructions (warm-up: %lu)\n",
+            ninstrs, nintervals, interval_len, warmup);
+    }
+    nintervals = states.size();
+
+    struct IntervalResult_t {
+        uint64_t cycles;
+        uint64_t instret;
+        double   wall_time;
+        bool     ok;
+    };
+    size_t njobs_total = nintervals + (compare ? 1 : 0);
+    std::vector<IntervalResult_t> results(njobs_total, {0, 0, 0.0, false});
+    std::atomic<size_t> next_job(0);
+    std::atomic<bool> config_failed(false);
+
+    std::vector<std::thread> workers;
+    njobs = std::max(1u, std::min<unsigned>(njobs, njobs_total));
+    for(unsigned j = 0; j < njobs; j++) {
+        workers.emplace_back([&]() {
+            OptArgs_t args = opt_args;
+            OrionSim sim(get_nthreads(args));
+            if(!sim.is_ready() || !configure_sim(sim, args)) {
+                config_failed = true;
+                return;
+            }
+            sim.set_console(false);
+
+            size_t i;
+            while((i = next_job++) < njobs_total) {
+                auto wall_start = std::chrono::steady_clock::now();
+                sim.reset_state();
+                if(i < nintervals) {
+                    // Interval from its snapshot
+                    sim.set_start_state(&states[i]);
+                    sim.set_roi_start(i * interval_len);
+                    sim.set_max_instret(std::min((i + 1) * interval_len, ninstrs));
+                    sim.set_max_cycles(states[i].cycles + max_cycles);
+                }
+                else {
+                    // Serial run of the whole program
+                    sim.set_start_state(nullptr);
+                    sim.load_program(prog_file);
+                    sim.set_roi_start(0);
+                    sim.set_max_instret(ninstrs);
+                    sim.set_max_cycles(max_cycles);
+                }
+                sim.run();
+                std::chrono::duration<double> wall_time = std::chrono::steady_clock::now() - wall_start;
+                results[i] = {sim.get_roi_cycles(), sim.get_roi_instret(), wall_time.count(),
+                    sim.has_roi() && sim.get_term_cause() != TERM_CAUSE_MAX_CYCLES && sim.get_term_cause() != TERM_CAUSE_FINISH};
+            }
+        });
+    }
+    for(auto &w: workers) {
+        w.join();
+    }
+    if(config_failed) {
+        return 1;
+    }
+
+    // Stitch the intervals
+    uint64_t total_cycles = 0, total_instret = 0;
+    double max_wall_time = 0.0;
+    bool ok = true;
+    for(size_t i = 0; i < nintervals; i++) {
+        const IntervalResult_t &r = results[i];
+        if(verbosity > NONE) {
+            printf("[interval] %-3lu %s  start: %-10lu  instret: %-10lu  cycles: %-10lu  IPC: %.4f\n", i, r.ok ? "OK  " : "FAIL",
+                i * interval_len, r.instret, r.cycles, r.cycles > 0 ? (double)r.instret / r.cycles : 0.0);
+        }
+        total_cycles += r.cycles;
+        total_instret += r.instret;
+        max_wall_time = std::max(max_wall_time, r.wall_time);
+        ok = ok && r.ok;
+    }
+    double ipc = total_cycles > 0 ? (double)total_instret / total_cycles : 0.0;
+    if(verbosity > NONE) {
+        printf("[interval] Stitched: instret: %lu  cycles: %lu  IPC: %.6f  (longest interval: %.3f s)\n",
+            total_instret, total_cycles, ipc, max_wall_time);
+    }
+    if(compare) {
+        const IntervalResult_t &r = results[nintervals];
+        double serial_ipc = r.cycles > 0 ? (double)r.instret / r.cycles : 0.0;
+        if(verbosity > NONE) {
+            printf("[interval] Serial:   instret: %lu  cycles: %lu  IPC: %.6f  (wall time: %.3f s)\n",
+                r.instret, r.cycles, serial_ipc, r.wall_time);
+            printf("[interval] Error: cycles %+.3f%%, IPC %+.3f%%\n",
+                r.cycles > 0 ? 100.0 * ((double)total_cycles - r.cycles) / r.cycles : 0.0,
+                serial_ipc > 0 ? 100.0 * (ipc - serial_ipc) / serial_ipc : 0.0);
+        }
+        ok = ok && r.ok;
+    }
+    return ok ? 0 : 1;
+}
+
+// Fork variant: one child simulation forked from the snapshot point
+struct ForkVariant_t {
+    std::string name;
+    uint64_t    max_cycles;
+    std::vector<std::pair<uint32_t, uint32_t>> pokes;   // (address, word) written before resuming
+};
+
+// Result of a forked child, sent to the parent over a pipe
+struct ForkResult_t {
+    int          rv;
+    Term_cause_t term_cause;
+    uint64_t     cycles;
+    uint64_t     instret;
 };
 
+// Parse a fork variants file; each line holds one variant:
+//   <name> [max_cycles=<N>] [poke=<addr>:<word>]...
+// Empty lines and lines starting with '#' are ignored.
+bool parse_fork_variants(const std::string &filename, uint64_t default_max_cycles, std::vector<ForkVariant_t> &variants) {
+    std::ifstream vfile(filename);
+    if(!vfile.is_open()) {
+        fprintf(stderr, "Error: Could not open fork variants file: %s\n", filename.c_str());
+        return false;
+    }
+
+    std::string line;
+    unsigned lineno = 0;
+    while(std::getline(vfile, line)) {
+        lineno++;
+        std::istringstream fields(line);
+        std::string name, param;
+        if(!(fields >> name) || name[0] == '#') {
+            continue;
+        }
+
+        ForkVariant_t variant = {name, default_max_cycles, {}};
+        while(fields >> param) {
+            // Every number must be present and parsed up to its delimiter
+            bool ok = false;
+            char *end = nullptr;
+            if(param.compare(0, 11, "max_cycles=") == 0) {
+                const char *start = param.c_str() + 11;
+                variant.max_cycles = strtoull(start, &end, 0);
+                ok = end != start && *end == '\0';
+            }
+            else if(param.compare(0, 5, "poke=") == 0) {
+                const char *start = param.c_str() + 5;
+                uint32_t addr = strtoul(start, &end, 0);
+                if(end != start && *end == ':') {
+                    start = end + 1;
+                    uint32_t word = strtoul(start, &end, 0);
+                    ok = end != start && *end == '\0';
+                    variant.pokes.push_back({addr, word});
+                }
+            }
+            if(!ok) {
+                fprintf(stderr, "Error: %s:%u: Invalid variant parameter: %s\n", filename.c_str(), lineno, param.c_str());
+                return false;
+            }
+        }
+        variants.push_back(variant);
+    }
+    return true;
+}
+
+// Simulate the program up to the snapshot point, then fork one child per
+// variant from that state (copy-on-write, so the children share the warmed-up
+// model memory). At most njobs children run at a time; the console output of
+// each child goes to <variant>.out.
+int run_forked(OrionSim &sim, const std::vector<ForkVariant_t> &variants, unsigned njobs) {
+    struct Child_t {
+        size_t variant;
+        int    fd;
+    };
+    std::map<pid_t, Child_t> children;
+    std::vector<ForkResult_t> results(variants.size(), {-1, TERM_CAUSE_UNKNOWN, 0, 0});
+    std::vector<bool> done(variants.size(), false);
+
+    // Reap one child and collect its result
+    auto reap = [&]() {
+        int status;
+        pid_t pid = wait(&status);
+        auto it = children.find(pid);
+        if(it == children.end()) {
+            return;
+        }
+        ForkResult_t res;
+        if(read(it->second.fd, &res, sizeof(res)) == sizeof(res)) {
+            results[it->second.variant] = res;
+            done[it->second.variant] = true;
+        }
+        close(it->second.fd);
+        children.erase(it);
+    };
+
+    // Flush buffered output, it would be duplicated in every child
+    fflush(stdout);
+    fflush(stderr);
+
+    SIMLOG("Forking %lu variants @ cycle %lu\n", variants.size(), sim.get_cycles());
+    for(size_t i = 0; i < variants.size() && !stop_signal; i++) {
+        while(children.size() >= njobs) {
+            reap();
+        }
+
+        int fds[2];
+        if(pipe(fds) != 0) {
+            perror("pipe");
+            break;
+        }
+        fflush(stdout);
+        pid_t pid = fork();
+        if(pid < 0) {
+            perror("fork");
+            close(fds[0]);
+            close(fds[1]);
+            break;
+        }
+
+        if(pid == 0) {
+            // Child: apply the variant and resume the simulation
+            const ForkVariant_t &v = variants[i];
+            close(fds[0]);
+            // No signal thread here: interrupt signals kill the child
+            sigset_t set;
+            get_stop_signals(set);
+            pthread_sigmask(SIG_UNBLOCK, &set, nullptr);
+            if(!freopen((v.name + ".out").c_str(), "w", stdout)) {
+                _exit(1);
+            }
+
+            ForkResult_t res = {-1, TERM_CAUSE_UNKNOWN, 0, 0};
+            bool ok = true;
+            for(auto &poke: v.pokes) {
+                ok = ok && sim.write_mem_word(poke.first, poke.second);
+            }
+            if(ok) {
+                sim.set_max_cycles(v.max_cycles);
+                res.rv = sim.run();
+                res.term_cause = sim.get_term_cause();
+                res.cycles = sim.get_cycles();
+                res.instret = sim.get_instret();
+            }
+            fflush(stdout);
+            if(write(fds[1], &res, sizeof(res)) != sizeof(res)) {
+                _exit(1);
+            }
+            // Skip the destructors, the parent owns the model
+            _exit(0);
+        }
+
+        close(fds[1]);
+        children[pid] = {i, fds[0]};
+    }
+    while(!children.empty()) {
+        reap();
+    }
+
+    // Report
+    int nfailed = 0;
+    for(size_t i = 0; i < variants.size(); i++) {
+        bool pass = done[i] && results[i].term_cause == TERM_CAUSE_TERM_REQ && results[i].rv == 0;
+        nfailed += !pass;
+        if(verbosity > NONE) {
+            printf("[fork] %s  retcode: %-3d  cycles: %lu  instret: %lu%s  %s\n",
+                pass ? "PASS" : "FAIL", results[i].rv, results[i].cycles, results[i].instret,
+                results[i].term_cause == TERM_CAUSE_MAX_CYCLES ? " (max cycles reached)" : (done[i] ? "" : " (no result)"),
+                variants[i].name.c_str());
+        }
+    }
+    if(verbosity > NONE) {
+        printf("[fork] Passed: %lu, Failed: %d\n", variants.size() - nfailed, nfailed);
+    }
+    return nfailed > 0 ? 1 : 0;
+}
+
+// Simulate a program up to the snapshot point (--fork-at / --fork-at-pc) and
+// fork the variants from there
+int run_fork_mode(OptArgs_t opt_args, const std::string &prog_file, unsigned njobs) {
+    // fork() only duplicates the calling thread
+    if(get_nthreads(opt_args) != 1) {
+        SIMERR("Fork mode needs a single-threaded model\n");
+        return 1;
+    }
+
+    OrionSim sim(1);
+    if(!sim.is_ready() || !configure_sim(sim, opt_args)) {
+        return 1;
+    }
+
+    std::vector<ForkVariant_t> variants;
+    if(!parse_fork_variants(opt_args["fork_variants"].value.as_str, sim.get_max_cycles(), variants)) {
+        return 1;
+    }
+
+    if(opt_args.count("restore_checkpoint") > 0) {
+        if(!sim.restore_checkpoint(opt_args["restore_checkpoint"].value.as_str)) {
+            return 1;
+        }
+    }
+    else if(!sim.load_program(prog_file)) {
+        return 1;
+    }
+
+    // Advance to the snapshot point (exactly one of them is given, checked in
+    // main)
+    bool reached;
+    if(opt_args.count("fork_at_pc") > 0) {
+        std::string pc_s = opt_args["fork_at_pc"].value.as_str;
+        char *end = nullptr;
+        uint32_t pc = strtoul(pc_s.c_str(), &end, 0);
+        if(*end != '\0' && !sim.get_symbol(pc_s, pc)) {
+            SIMERR("Invalid PC: %s\n", pc_s.c_str());
+            return 1;
+        }
+        SIMLOG("Simulating up to PC: 0x%08x\n", pc);
+        reached = sim.advance_to_pc(pc);
+    }
+    else {
+        uint64_t cycle = opt_args["fork_at"].value.as_int;
+        SIMLOG("Simulating up to cycle: %lu\n", cycle);
+        reached = sim.advance_to_cycle(cycle);
+    }
+    if(!reached) {
+        SIMERR("Simulation terminated before reaching the snapshot point (cycle: %lu)\n", sim.get_cycles());
+        return 1;
+    }
 
+    return run_forked(sim, variants, njobs);
+}
 
 int main(int argc, char** argv) {
     // Parse Arguments
@@ -473,8 +2724,40 @@ int main(int argc, char** argv) {
     parser.add_argument({"--trace-file"}, "Specify a trace file (Trace type: " TRACE_TYPE_STR ")", ArgParse::ArgType_t::STR, TRACE_FILE);
     parser.add_argument({"-l", "--log"}, "Enable simulation log", ArgParse::ArgType_t::STR);
     parser.add_argument({"-v", "--verbosity"}, "Set verbosity (ALL=3, DEFAULT=2, ERRORS=1, NONE=0)", ArgParse::ArgType_t::INT);
-    parser.add_argument({"--log-format"}, "Specify log format (choices: spike, default)", ArgParse::ArgType_t::STR);
+    parser.add_argument({"--log-format"}, "Specify log format (choices: spike, default, bin)", ArgParse::ArgType_t::STR);
+    parser.add_argument({"--flush-policy"}, "When the log and trace buffers are written to their files (choices: line, interval, exit)", ArgParse::ArgType_t::STR, "interval");
+    parser.add_argument({"--load-bin"}, "Load raw binary data images after the program (FILE@ADDR[,FILE@ADDR...])", ArgParse::ArgType_t::STR);
+    parser.add_argument({"--map"}, "Map host files into memory after the program, copy-on-write or read-only (FILE@ADDR[:ro][,...], page aligned; copied unless MEM_MODEL=sparse)", ArgParse::ArgType_t::STR);
+    parser.add_argument({"--imem-timing"}, "DPI memory imem port timing: lat=N,jitter=N (MEM_MODEL=dpi builds)", ArgParse::ArgType_t::STR);
+    parser.add_argument({"--dmem-timing"}, "DPI memory dmem port timing: lat=N|rlat=N,wlat=N,jitter=N (MEM_MODEL=dpi builds)", ArgParse::ArgType_t::STR);
+    parser.add_argument({"--mem-bw"}, "DPI memory bandwidth shared by both ports in bytes per cycle (0: unlimited)", ArgParse::ArgType_t::INT);
+    parser.add_argument({"--mem-seed"}, "Seed of the DPI memory latency jitter", ArgParse::ArgType_t::INT, "1");
+    parser.add_argument({"--blk"}, "Attach a read-only block device backed by a host file (registers below VDEV)", ArgParse::ArgType_t::STR);
+    parser.add_argument({"--blk-latency"}, "Cycles from a block device command to its completion", ArgParse::ArgType_t::INT, "1000");
     parser.add_argument({"--dump-mem"}, "Dump memory contents to a file after simulation finishes", ArgParse::ArgType_t::STR);
+    parser.add_argument({"--fast-tick"}, "Use the fast-clock path even when logging (default when neither --trace nor --log is given)", ArgParse::ArgType_t::BOOL, "false");
+    parser.add_argument({"--no-vdev"}, "Disable VDEV evaluation (no console, counters or software exit)", ArgParse::ArgType_t::BOOL, "false");
+    parser.add_argument({"--no-idle-skip"}, "Tick every cycle the core sleeps in WFI instead of skipping to the timer deadline", ArgParse::ArgType_t::BOOL, "false");
+    parser.add_argument({"--poll-warp"}, "Skip ahead in loops polling the VDEV cycle counter instead of simulating every iteration (untraced runs)", ArgParse::ArgType_t::BOOL, "false");
+    parser.add_argument({"--no-instret"}, "Disable counting retired instructions (requires --no-vdev)", ArgParse::ArgType_t::BOOL, "false");
+    parser.add_argument({"--fast-forward"}, "Execute the first N instructions on the built-in RV32IM ISS, then switch to RTL", ArgParse::ArgType_t::INT);
+    parser.add_argument({"--cosim"}, "Check every retired instruction against the built-in RV32IM reference model, stop on the first mismatch", ArgParse::ArgType_t::BOOL, "false");
+    parser.add_argument({"--max-instret"}, "Stop after the given number of retired instructions (including fast-forwarded ones)", ArgParse::ArgType_t::INT);
+    parser.add_argument({"--roi-start"}, "Start the region of interest (cycles/IPC reported separately) after the given number of retired instructions", ArgParse::ArgType_t::INT);
+    parser.add_argument({"--bbv"}, "Write SimPoint basic block vectors to a file", ArgParse::ArgType_t::STR);
+    parser.add_argument({"--bbv-interval"}, "Basic block vector interval length in instructions", ArgParse::ArgType_t::INT, "1000000");
+    parser.add_argument({"--intervals"}, "Split the program into N instruction intervals simulated in parallel (ISS snapshots) and stitch the IPC", ArgParse::ArgType_t::INT);
+    parser.add_argument({"--interval-warmup"}, "Warm-up instructions simulated in RTL before each interval", ArgParse::ArgType_t::INT, "10000");
+    parser.add_argument({"--interval-compare"}, "Also simulate the program serially and compare it with the stitched intervals", ArgParse::ArgType_t::BOOL, "false");
+    parser.add_argument({"--save-checkpoint-at"}, "Save a checkpoint when the cycle count reaches the given cycle", ArgParse::ArgType_t::INT);
+    parser.add_argument({"--checkpoint-file"}, "Specify the file --save-checkpoint-at saves to", ArgParse::ArgType_t::STR, "orionsim.ckpt");
+    parser.add_argument({"--restore-checkpoint"}, "Start the simulation from a saved checkpoint instead of reset (no program file needed)", ArgParse::ArgType_t::STR);
+    parser.add_argument({"--fork-variants"}, "Fork one child per variant in the file (<name> [max_cycles=N] [poke=ADDR:WORD]... per line) from the snapshot point", ArgParse::ArgType_t::STR);
+    parser.add_argument({"--fork-at"}, "Snapshot point for --fork-variants: cycle", ArgParse::ArgType_t::INT);
+    parser.add_argument({"--fork-at-pc"}, "Snapshot point for --fork-variants: first retired instruction at this PC (or ELF symbol)", ArgParse::ArgType_t::STR);
+    parser.add_argument({"--threads"}, "Number of simulation threads per model (model verilated with " STRINGIFY(SIM_THREADS) ")", ArgParse::ArgType_t::INT);
+    parser.add_argument({"-j", "--jobs"}, "Number of models simulated concurrently when several program files or a batch are given", ArgParse::ArgType_t::INT);
+    parser.add_argument({"--batch"}, "Run the programs listed in a manifest file (<program> [max-cycles] [expected-retcode] [blk=FILE] per line), reusing the model", ArgParse::ArgType_t::STR);
 
     if(parser.parse_args(argc, argv) != 0) {
         return 1;
@@ -492,50 +2775,132 @@ int main(int argc, char** argv) {
         verbosity = verb;
     }
 
-    // Create the simulator instance
-    OrionSim sim;
+    // Check number of simulation threads
+    if(opt_args.count("threads") > 0) {
+        long int nthreads = opt_args["threads"].value.as_int;
+        if(nthreads < SIM_THREADS) {
+            SIMERR("Model was verilated with %d threads, cannot run with %ld\n", SIM_THREADS, nthreads);
+            return 1;
+        }
+    }
 
-    // Open trace file
-    if(opt_args["trace"].value.as_bool) {
-        std::string trace_file = opt_args["trace_file"].value.as_str;
-        sim.open_trace(trace_file);
+    // Check the program files
+    bool batch = opt_args.count("batch") > 0;
+    bool restore = opt_args.count("restore_checkpoint") > 0;
+    if(pos_args.size() == 0 && !batch && !restore) {
+        fprintf(stderr, "Error: No program file specified\n");
+        return 1;
     }
 
-    // Enable simulation log
-    if(opt_args.count("log") > 0) {
-        std::string log_file = opt_args["log"].value.as_str;
-        sim.open_log(log_file);
+    // Check the flush policy, stop the run cleanly on interrupt signals and
+    // finish the log and trace files if it crashes
+    FlushPolicy_t flush_policy;
+    if(!parse_flush_policy(opt_args["flush_policy"].value.as_str, flush_policy)) {
+        fprintf(stderr, "Error: Unknown flush policy: %s\n", opt_args["flush_policy"].value.as_str);
+        return 1;
     }
+    start_signal_thread();
+    LogWriter::install_crash_handlers();
 
-    // Set log format
-    if(opt_args.count("log_format") > 0) {
-        std::string log_format = opt_args["log_format"].value.as_str;
-        sim.set_log_format(log_format);
-    }  
+    // Check the data images and file mappings
+    if(opt_args.count("load_bin") > 0) {
+        std::vector<std::pair<std::string, uint32_t>> images;
+        if(!parse_data_images(opt_args["load_bin"].value.as_str, images)) {
+            return 1;
+        }
+    }
+    if(opt_args.count("map") > 0) {
+        std::vector<Mapping_t> maps;
+        if(!parse_mappings(opt_args["map"].value.as_str, maps)) {
+            return 1;
+        }
+    }
 
-    // Set maximum cycles
-    if(opt_args.count("max_cycles") > 0) {
-        uint64_t max_cycles = (uint64_t) opt_args["max_cycles"].value.as_int;
-        sim.set_max_cycles(max_cycles);
+    // Check the block device
+    if(opt_args.count("blk") > 0) {
+        struct stat st;
+        if(stat(opt_args["blk"].value.as_str, &st) != 0) {
+            fprintf(stderr, "Error: Could not open block device file: %s\n", opt_args["blk"].value.as_str);
+            return 1;
+        }
+        if(opt_args["blk_latency"].value.as_int < 0) {
+            fprintf(stderr, "Error: --blk-latency must not be negative\n");
+            return 1;
+        }
     }
 
-    // Load the program file
-    if(pos_args.size() > 0) {
-        std::string hex_file = pos_args[0];
-        sim.load_hex(hex_file);
-    } else {
-        fprintf(stderr, "Error: No program file specified\n");
+    // Check the DPI memory timing
+    if(opt_args.count("imem_timing") > 0 || opt_args.count("dmem_timing") > 0 || opt_args.count("mem_bw") > 0) {
+#ifdef SIM_MEM_DPI
+        MemTiming_t timing;
+        if((opt_args.count("imem_timing") > 0 && !parse_mem_timing(opt_args["imem_timing"].value.as_str, timing)) ||
+            (opt_args.count("dmem_timing") > 0 && !parse_mem_timing(opt_args["dmem_timing"].value.as_str, timing))) {
+            return 1;
+        }
+        if(opt_args.count("mem_bw") > 0 && opt_args["mem_bw"].value.as_int < 0) {
+            fprintf(stderr, "Error: --mem-bw must not be negative\n");
+            return 1;
+        }
+#else
+        fprintf(stderr, "Error: Memory timing options need a DPI memory build (make sim MEM_MODEL=dpi)\n");
         return 1;
+#endif
     }
 
-    // Run the simulation
-    int rv = sim.run();
+    unsigned njobs = opt_args.count("jobs") > 0 ? opt_args["jobs"].value.as_int : std::thread::hardware_concurrency();
+    njobs = std::max(1u, njobs);
 
-    // Dump memory contents to a file
-    if(opt_args.count("dump_mem") > 0) {
-        std::string dump_file = opt_args["dump_mem"].value.as_str;
-        sim.dump_mem(dump_file);
+    if(opt_args.count("fork_variants") > 0) {
+        if(pos_args.size() > 1 || batch || opt_args["trace"].value.as_bool || opt_args.count("log") > 0 ||
+            opt_args.count("dump_mem") > 0 || opt_args.count("save_checkpoint_at") > 0 || opt_args.count("bbv") > 0) {
+            fprintf(stderr, "Error: --fork-variants needs a single program file and no --trace, --log, --dump-mem, --bbv or --save-checkpoint-at\n");
+            return 1;
+        }
+        if((opt_args.count("fork_at") > 0) == (opt_args.count("fork_at_pc") > 0)) {
+            fprintf(stderr, "Error: --fork-variants needs a snapshot point: either --fork-at or --fork-at-pc\n");
+            return 1;
+        }
+        return run_fork_mode(opt_args, pos_args.size() > 0 ? pos_args[0] : "", njobs);
     }
 
-    return rv;
+    if(opt_args.count("intervals") > 0) {
+        if(pos_args.size() != 1 || batch || restore || opt_args["trace"].value.as_bool || opt_args.count("log") > 0 ||
+            opt_args.count("dump_mem") > 0 || opt_args.count("save_checkpoint_at") > 0 || opt_args.count("bbv") > 0) {
+            fprintf(stderr, "Error: --intervals needs a single program file and no --trace, --log, --dump-mem, --bbv or checkpoints\n");
+            return 1;
+        }
+        if(opt_args["intervals"].value.as_int < 1) {
+            fprintf(stderr, "Error: --intervals must be at least 1\n");
+            return 1;
+        }
+        return run_intervals(opt_args, pos_args[0], opt_args["intervals"].value.as_int, opt_args["interval_warmup"].value.as_int,
+            opt_args["interval_compare"].value.as_bool, njobs);
+    }
+
+    if(pos_args.size() <= 1 && !batch) {
+        return run_program(opt_args, pos_args.size() > 0 ? pos_args[0] : "");
+    }
+
+    // Several programs: per-run output files would clash
+    if(opt_args["trace"].value.as_bool || opt_args.count("log") > 0 || opt_args.count("dump_mem") > 0 ||
+        opt_args.count("save_checkpoint_at") > 0 || restore || opt_args.count("bbv") > 0) {
+        fprintf(stderr, "Error: --trace, --log, --dump-mem, --bbv and checkpoints need a single program file\n");
+        return 1;
+    }
+
+    if(batch) {
+        uint64_t max_cycles = opt_args.count("max_cycles") > 0 ? opt_args["max_cycles"].value.as_int : SIM_MAX_CYCLES;
+        std::vector<BatchEntry_t> entries;
+        if(!parse_batch_manifest(opt_args["batch"].value.as_str, max_cycles, entries)) {
+            return 1;
+        }
+        for(auto &p: pos_args) {
+            entries.push_back({p, max_cycles, 0, ""});
+        }
+        njobs = std::max(1u, std::min<unsigned>(njobs, entries.size()));
+        return run_batch(opt_args, entries, njobs);
+    }
+
+    njobs = std::max(1u, std::min<unsigned>(njobs, pos_args.size()));
+    return run_programs(opt_args, pos_args, njobs);
 }
@@ -0,0 +1,263 @@
+#include "poll_warp.h"
+
+#include <algorithm>
+
+// Instruction fields
+#define OPCODE(i)   ((i) & 0x7f)
+#define RD(i)       (((i) >> 7) & 0x1f)
+#define RS1(i)      (((i) >> 15) & 0x1f)
+#define RS2(i)      (((i) >> 20) & 0x1f)
+
+// Opcodes
+#define OP_LUI      0x37
+#define OP_AUIPC    0x17
+#define OP_JAL      0x6f
+#define OP_JALR     0x67
+#define OP_BRANCH   0x63
+#define OP_LOAD     0x03
+#define OP_IMM      0x13
+#define OP_REG      0x33
+
+bool PollWarp::poll(uint32_t pc, uint64_t cycles, uint64_t instret) {
+    now = cycles;
+
+    // Last presentation of each counter load (a polling loop has a few)
+    auto it = std::find_if(loads.begin(), loads.end(), [pc](const std::pair<uint32_t, uint64_t> &l) { return l.first == pc; });
+    bool     recurs = it != loads.end();
+    uint64_t prev   = recurs ? it->second : 0;
+    if(recurs) {
+        it->second = cycles;
+    } else {
+        if(loads.size() >= MAX_LOADS) {
+            loads.clear();
+        }
+        loads.push_back({pc, cycles});
+    }
+
+    if(!tracking || pc != track_pc) {
+        // Follow another load once the tracked one stopped recurring (it did
+        // not come by since the previous presentation of this one)
+        if(!tracking || (recurs && last_cycles < prev) || cycles - last_cycles > MAX_PERIOD) {
+            tracking      = true;
+            track_pc      = pc;
+            rejected      = false;
+            last_cycles   = cycles;
+            last_instret  = instret;
+            period_cycles = 0;
+            period_instrs = 0;
+            nstable       = 0;
+            state         = STATE_DETECT;
+        }
+        return state == STATE_ARMED && pc == anchor_pc;
+    }
+
+    uint64_t dc = cycles - last_cycles;
+    uint64_t di = instret - last_instret;
+    last_cycles  = cycles;
+    last_instret = instret;
+    if(dc != period_cycles || di != period_instrs || dc > MAX_PERIOD || di == 0) {
+        period_cycles = dc;
+        period_instrs = di;
+        nstable = 0;
+        state = STATE_DETECT;
+        return false;
+    }
+
+    if(state == STATE_DETECT && ++nstable >= STABLE_PERIODS && !rejected) {
+        state    = STATE_RECORD;
+        started  = false;
+        nretired = 0;
+        loop.clear();
+    }
+    return state == STATE_ARMED && pc == anchor_pc;
+}
+
+void PollWarp::retire(uint32_t pc, uint32_t instr, uint32_t addr, uint8_t rmask, uint8_t wmask) {
+    bool counter = rmask && addr - counter_addr < 8;
+
+    // The period starts and ends at a load of the tracked PC
+    if(!started) {
+        if(pc != track_pc || !counter) {
+            if(++nretired > 2 * MAX_LEN) {
+                state = STATE_DETECT;
+            }
+            return;
+        }
+        started = true;
+    } else if(pc == track_pc) {
+        if(accept()) {
+            state = STATE_ARMED;
+        } else {
+            rejected = true;
+            state = STATE_DETECT;
+        }
+        return;
+    }
+
+    bool ok;
+    switch(OPCODE(instr)) {
+        case OP_LUI: case OP_AUIPC: case OP_JAL: case OP_JALR:
+        case OP_BRANCH: case OP_LOAD: case OP_IMM: case OP_REG:
+            ok = true;
+            break;
+        default:
+            ok = false;
+            break;
+    }
+    ok = ok && !wmask && !(rmask && !counter && addr - dev_addr < dev_size) && loop.size() < MAX_LEN;
+
+    // Simple loops only: each instruction once per period
+    for(auto &i: loop) {
+        ok = ok && i.pc != pc;
+    }
+    if(!ok) {
+        rejected = true;
+        state = STATE_DETECT;
+        return;
+    }
+    loop.push_back({pc, instr, counter, 0});
+}
+
+bool PollWarp::accept() {
+    if(loop.size() != period_instrs) {
+        return false;
+    }
+
+    // Cut before a counter load such that no register read before being
+    // written in the loop is written in it
+    size_t n = loop.size();
+    for(size_t c = 0; c < n; c++) {
+        if(!loop[c].counter) {
+            continue;
+        }
+        uint32_t livein  = 0;
+        uint32_t written = 0;
+        for(size_t k = 0; k < n; k++) {
+            uint32_t instr = loop[(c + k) % n].instr;
+            uint32_t reads = 0;
+            bool     writes = true;
+            switch(OPCODE(instr)) {
+                case OP_JALR:
+                case OP_LOAD:
+                case OP_IMM:
+                    reads = 1u << RS1(instr);
+                    break;
+                case OP_BRANCH:
+                    writes = false;
+                    // fallthrough
+                case OP_REG:
+                    reads = (1u << RS1(instr)) | (1u << RS2(instr));
+                    break;
+                default:
+                    break;
+            }
+            livein |= reads & ~written;
+            if(writes) {
+                written |= 1u << RD(instr);
+            }
+        }
+        if((livein & written & ~1u) == 0) {
+            std::rotate(loop.begin(), loop.begin() + c, loop.end());
+            anchor_pc = loop[0].pc;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t PollWarp::plan(const uint32_t *regs, uint64_t max_periods) {
+    // One warp per detection: the skipped cycles break the period, so the
+    // loop is found again if it keeps running
+    state   = STATE_DETECT;
+    nstable = 0;
+
+    // Cycles from the cut to each counter load: their last presentations
+    // belong to the previous period
+    for(auto &i: loop) {
+        if(!i.counter) {
+            continue;
+        }
+        if(i.pc == anchor_pc) {
+            i.rel = 0;
+            continue;
+        }
+        auto it = std::find_if(loads.begin(), loads.end(), [&i](const std::pair<uint32_t, uint64_t> &l) { return l.first == i.pc; });
+        if(it == loads.end() || it->second >= now || it->second + period_cycles <= now) {
+            return 0;
+        }
+        i.rel = it->second + period_cycles - now;
+    }
+
+    // Largest number of periods after which the loop still iterates
+    // (emulate(lo) holds, emulate(hi) fails or hi is the limit)
+    uint64_t limit = std::min<uint64_t>(max_periods, 1ull << MAX_PERIODS_LOG) + 1;
+    if(limit < 2 || !emulate(regs, 0)) {
+        return 0;
+    }
+    uint64_t lo = 0;
+    uint64_t hi = 1;
+    while(hi < limit && emulate(regs, hi)) {
+        lo = hi;
+        hi *= 2;
+    }
+    hi = std::min(hi, limit);
+    while(hi - lo > 1) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if(emulate(regs, mid)) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // Keep the last looping iteration in the RTL, so that the registers the
+    // loop writes hold simulated values at the exit
+    if(lo < 2) {
+        return 0;
+    }
+    nwarps++;
+    warped_cycles += (lo - 1) * period_cycles;
+    return lo - 1;
+}
+
+bool PollWarp::emulate(const uint32_t *regs, uint64_t n) {
+    emu.reset(anchor_pc);
+    for(unsigned r = 1; r < 32; r++) {
+        emu.set_reg(r, regs[r]);
+    }
+    uint64_t base = now + n * period_cycles;
+    for(auto &i: loop) {
+        if(emu.get_pc() != i.pc || i.pc - mem_addr >= mem_size || mem[(i.pc - mem_addr) / 4] != i.instr) {
+            return false;
+        }
+        emu_cycles = base + i.rel;
+        emu_fault  = false;
+        if(emu.run(1) != 1 || emu_fault) {
+            return false;
+        }
+    }
+    return emu.get_pc() == anchor_pc;
+}
+
+void PollWarp::reset() {
+    state    = STATE_DETECT;
+    tracking = false;
+    rejected = false;
+    nstable  = 0;
+    loads.clear();
+    loop.clear();
+}
+
+uint32_t PollWarp::mmio_load(uint32_t addr) {
+    // Counter value at the load in the emulated period
+    switch(addr - counter_addr) {
+        case 0:     return (uint32_t)emu_cycles;
+        case 4:     return (uint32_t)(emu_cycles >> 32);
+        default:    emu_fault = true; return 0;
+    }
+}
+
+bool PollWarp::mmio_store(uint32_t addr, uint32_t data, uint8_t mask) {
+    emu_fault = true;
+    return true;
+}
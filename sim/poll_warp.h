@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+#include "iss.h"
+
+/*
+    PollWarp: busy-wait time warp
+    =============================
+    Finds loops that only spin on the cycle counter (VDEV CYCLE/CYCLE_HI) and
+    computes how many of their iterations can be skipped, so that the
+    simulator advances the cycle and instruction counters instead of
+    evaluating the RTL for each of them.
+
+    1.  Detection: the simulator reports each load of the counter presented on
+        the dmem port. When the loads of one PC recur with the same number of
+        cycles and retired instructions in between (the period) several
+        times, the retired instructions of one period are recorded.
+    2.  Check: the loop is accepted if it has no stores, no system
+        instructions, reads no device but the counter, and can be cut right
+        before a counter load so that every register it reads before writing
+        is never written in it (the loop-invariant state). Each iteration then
+        only depends on the counter values it reads.
+    3.  Warp: at the next counter load at the cut, one iteration is emulated
+        on the ISS with the counter values it would read a number of periods
+        later. The largest number of periods for which it still loops is
+        searched (the exit condition is assumed to be monotonic in time, as in
+        `while(cycles() < t)`), and one iteration less is skipped so that the
+        last iterations before the exit run in the RTL.
+
+    The pipeline timing repeats every period, so the guest observes the same
+    counter values as without the warp.
+*/
+class PollWarp: public Iss::MmioHandler {
+public:
+    // Emulates on the memory words mem, the counter is at counter_addr (8 bytes)
+    PollWarp(uint32_t *mem, uint32_t mem_addr, uint32_t mem_size, uint32_t counter_addr):
+        emu(mem, mem_addr, mem_size), mem(mem), mem_addr(mem_addr), mem_size(mem_size), counter_addr(counter_addr) {
+        emu.set_mmio(counter_addr, 8, this);
+    }
+
+    // Loads from the device window other than the counter reject a loop
+    void set_dev_window(uint32_t addr, uint32_t size) { dev_addr = addr; dev_size = size; }
+
+    // A load of the counter at pc is presented on the dmem port, returns true
+    // if a warp can be planned at this point
+    bool poll(uint32_t pc, uint64_t cycles, uint64_t instret);
+
+    // Record a retired instruction (only needed while is_recording())
+    inline bool is_recording() { return state == STATE_RECORD; }
+    void retire(uint32_t pc, uint32_t instr, uint32_t mem_addr, uint8_t rmask, uint8_t wmask);
+
+    // Number of periods to skip from the current poll(), at most max_periods
+    // (regs: register file of the core)
+    uint64_t plan(const uint32_t *regs, uint64_t max_periods);
+
+    uint64_t get_period_cycles() { return period_cycles; }
+    uint64_t get_period_instrs() { return period_instrs; }
+
+    // Forget the loops seen so far (the program changed)
+    void reset();
+
+    // Statistics
+    uint64_t get_warps() { return nwarps; }
+    uint64_t get_cycles() { return warped_cycles; }
+
+    uint32_t mmio_load(uint32_t addr) override;
+    bool mmio_store(uint32_t addr, uint32_t data, uint8_t mask) override;
+
+private:
+    enum {
+        STABLE_PERIODS  = 4,    // Equal periods before a loop is recorded
+        MAX_PERIOD      = 4096, // Longest period (cycles) of a polling loop
+        MAX_LEN         = 256,  // Longest loop (instructions)
+        MAX_LOADS       = 16,   // Counter load PCs remembered
+        MAX_PERIODS_LOG = 40    // At most 2^40 periods per warp
+    };
+
+    enum State_t {
+        STATE_DETECT,   // Looking for a periodic counter load
+        STATE_RECORD,   // Recording one period of retired instructions
+        STATE_ARMED     // Loop accepted, warp at the next load at the cut
+    };
+
+    struct Instr_t {
+        uint32_t pc;
+        uint32_t instr;
+        bool     counter;   // Counter load
+        uint64_t rel;       // Counter loads: cycles from the cut to the load
+    };
+
+    // Accept the recorded period (sets loop and anchor_pc)
+    bool accept();
+
+    // Emulate the iteration starting at the cut n periods from now, returns
+    // true if it comes back to the cut
+    bool emulate(const uint32_t *regs, uint64_t n);
+
+    Iss      emu;
+    uint32_t *mem;
+    uint32_t mem_addr;
+    uint32_t mem_size;
+    uint32_t counter_addr;
+    uint32_t dev_addr = 0;
+    uint32_t dev_size = 0;
+
+    State_t  state = STATE_DETECT;
+
+    // Detection (loads of track_pc)
+    bool     tracking      = false;
+    uint32_t track_pc      = 0;
+    bool     rejected      = false;     // The loop of track_pc was rejected
+    uint64_t last_cycles   = 0;
+    uint64_t last_instret  = 0;
+    uint64_t period_cycles = 0;
+    uint64_t period_instrs = 0;
+    unsigned nstable       = 0;
+
+    // Last presentation of each counter load (pc, cycles)
+    std::vector<std::pair<uint32_t, uint64_t>> loads;
+    uint64_t now = 0;
+
+    // Recorded period, then the loop from the cut
+    std::vector<Instr_t> loop;
+    bool     started = false;
+    uint64_t nretired = 0;
+    uint32_t anchor_pc = 0;
+
+    // Emulation
+    uint64_t emu_cycles = 0;
+    bool     emu_fault  = false;
+
+    uint64_t nwarps        = 0;
+    uint64_t warped_cycles = 0;
+};
@@ -9,6 +9,12 @@
 #include <verilated_vcd_c.h>
 #endif
 
+#ifdef SIM_SAVABLE
+#include <verilated_save.h>
+#endif
+
+#include "log_writer.h"
+
 #define TIMESCALE 10
 
 /*
@@ -17,16 +23,47 @@
     - It supports both fst and vcd traces.
     - FST is recommended (but not default) as it is more compact and faster.
     - The testbench can be used with any top-level module.
+    - A fast-clock path (2 evals per cycle, no trace bookkeeping) can be
+      enabled for untraced runs.
+    - Each testbench owns its VerilatedContext, so several testbenches can
+      run concurrently on different threads.
+    - VCD traces are written through a LogWriter (buffered, gzip/zstd
+      compressed for .gz/.zst file names). Both trace formats are flushed as
+      the flush policy says, not every cycle.
 */
+
+#ifndef TRACE_FST
+// VCD output file of the trace, through a LogWriter
+class VcdWriterFile: public VerilatedVcdFile {
+public:
+    VcdWriterFile(FlushPolicy_t policy): policy(policy) {}
+
+    bool open(const std::string &name) override { return writer.open(name, policy); }
+    void close() override { writer.close(); }
+    ssize_t write(const char *bufp, ssize_t len) override {
+        writer.write(bufp, len);
+        return len;
+    }
+    void flush() { writer.flush(); }
+
+private:
+    LogWriter     writer;
+    FlushPolicy_t policy;
+};
+#endif
+
 template <class VTop>
 class Testbench {
 public:
+    // Simulation context (time, $finish, threads)
+    VerilatedContext* ctx_ = nullptr;
+
     // DUT
     VTop* dut_ = nullptr;
 
     //== Setup =============================
-    // Construct a testbench object
-    Testbench();
+    // Construct a testbench object (nthreads: threads used by the model)
+    Testbench(unsigned nthreads = 1);
 
     // Destruct the testbench object
     virtual ~Testbench();
@@ -39,12 +76,34 @@ public:
     // Check if simulation finished
     bool finished();
 
+    // Clear a $finish request (to reuse the model after it finished)
+    void clear_finished() { ctx_->gotFinish(false); }
+
     // Reset system
     void reset(int ncycles = 2);
 
     // Tick one cucle
     void tick();
 
+    // Tick one cycle with the minimum number of evals (no tracing)
+    inline void tick_fast();
+
+    // Tick one cycle with settle/rising/falling edge evals and tracing
+    void tick_full();
+
+    // Advance the cycle count and time without evaluating the model (for
+    // cycles spent outside of the RTL, e.g. fast-forwarded instructions)
+    void skip_cycles(uint64_t ncycles) {
+        cycles_ += ncycles;
+        ctx_->timeInc(ncycles * TIMESCALE);
+    }
+
+    // Enable the fast-clock path (only used while no trace is open)
+    void set_fast_tick(bool en) { fast_tick_ = en; }
+
+    // Check if ticks use the fast-clock path
+    bool is_fast_tick() { return fast_tick_ && !is_trace_open(); }
+
     //== Trace functions ===================
     // Check if trace is open
     inline virtual bool is_trace_open() { return trace_ != nullptr; }
@@ -55,20 +114,40 @@ public:
     // Close a trace
     virtual void close_trace();
 
+    // Set when the trace is flushed (before open_trace)
+    void set_trace_flush(FlushPolicy_t policy) { trace_flush_.set_policy(policy); }
+
+    // Write the dumped values to the trace file
+    void flush_trace();
+
     //===== Query simulation =====
     // get the number of cycles elapsed till now
     virtual uint64_t get_cycles() {return cycles_;}
 
     // get the current time in the simulation
-    virtual uint64_t get_time() {return Verilated::time();}
+    virtual uint64_t get_time() {return ctx_->time();}
+
+#ifdef SIM_SAVABLE
+    //===== Save/Restore =====
+    // Save the testbench (cycles, time) and model state
+    void save_state(VerilatedSerialize &os);
+
+    // Restore the testbench (cycles, time) and model state
+    void restore_state(VerilatedDeserialize &is);
+#endif
 
 private:
+    // Use the fast-clock path when no trace is open
+    bool fast_tick_ = false;
+
     // Trace file ptr
 #ifdef TRACE_FST
     VerilatedFstC * trace_ = nullptr;
 #else
     VerilatedVcdC * trace_ = nullptr;
+    VcdWriterFile * trace_file_ = nullptr;
 #endif
+    FlushTimer trace_flush_;
 
     // Track number of clock cyles
     uint64_t cycles_ = 0l;
@@ -80,9 +159,12 @@ private:
 
 
 template <class VTop>
-Testbench<VTop>::Testbench() {
-    dut_ = new VTop;
-    Verilated::traceEverOn(true);
+Testbench<VTop>::Testbench(unsigned nthreads) {
+    // Context must be configured before the model is created
+    ctx_ = new VerilatedContext;
+    ctx_->threads(nthreads);
+    ctx_->traceEverOn(true);
+    dut_ = new VTop{ctx_};
     cycles_ = 0L;
 }
 
@@ -91,12 +173,16 @@ Testbench<VTop>::~Testbench() {
     if(is_trace_open())
         close_trace();
     delete trace_;
+#ifndef TRACE_FST
+    delete trace_file_;
+#endif
     delete dut_;
+    delete ctx_;
 }
 
 template <class VTop>
 bool Testbench<VTop>::finished() {
-    return Verilated::gotFinish();
+    return ctx_->gotFinish();
 }
 
 template <class VTop>
@@ -112,9 +198,34 @@ void Testbench<VTop>::reset(int ncycles) {
 
 template <class VTop>
 void Testbench<VTop>::tick() {
+    if(fast_tick_ && !trace_)
+        tick_fast();
+    else
+        tick_full();
+}
+
+template <class VTop>
+inline void Testbench<VTop>::tick_fast() {
+    cycles_++;
+    ctx_->timeInc(TIMESCALE);
+
+    // The clock is already low (settled by the previous tick or reset), so
+    // the rising edge and any input changes are evaluated together.
+    *sig_clk_ = 1;
+    dut_->eval();
+
+    // Falling edge: needed so that the next rising edge is seen as an edge.
+    // Nothing is sensitive to it, so the outputs read between ticks are the
+    // same as after the full tick.
+    *sig_clk_ = 0;
+    dut_->eval();
+}
+
+template <class VTop>
+void Testbench<VTop>::tick_full() {
     // Increment our own internal time reference
     cycles_++;
-    Verilated::timeInc(TIMESCALE);
+    ctx_->timeInc(TIMESCALE);
     
     // Make sure any combinatorial logic depending upon
     // inputs that may have changed before we called tick()
@@ -145,31 +256,58 @@ void Testbench<VTop>::tick() {
         // After dumping our values as they exist on the
         // negative clock edge ...
         trace_->dump(TIMESCALE*cycles_+(TIMESCALE/2));
-        //
-        // We'll also need to make sure we flush any I/O to
-        // the trace file, so that we can use the assert()
-        // function between now and the next tick if we want to.
 
-#ifndef TRACE_FST
-        // Flushing each cycle in fst mode is too slow.
-        trace_->flush();
-#endif
+        // Flush as the policy says (a flush every cycle is a syscall every
+        // cycle; crashes are covered by the LogWriter signal handler)
+        if(trace_flush_.record_done())
+            flush_trace();
     }
 }
 
+#ifdef SIM_SAVABLE
+template <class VTop>
+void Testbench<VTop>::save_state(VerilatedSerialize &os) {
+    // Time is kept by the context, which is not part of the model
+    uint64_t time = ctx_->time();
+    os.write(&cycles_, sizeof(cycles_));
+    os.write(&time, sizeof(time));
+    os << *dut_;
+}
+
+template <class VTop>
+void Testbench<VTop>::restore_state(VerilatedDeserialize &is) {
+    uint64_t time = 0;
+    is.read(&cycles_, sizeof(cycles_));
+    is.read(&time, sizeof(time));
+    is >> *dut_;
+    ctx_->time(time);
+}
+#endif
+
 template <class VTop>
 void Testbench<VTop>::open_trace(std::string trace_file) {
     if(!is_trace_open()) {
 #ifdef TRACE_FST
         trace_ = new VerilatedFstC;
 #else
-        trace_ = new VerilatedVcdC;
+        trace_file_ = new VcdWriterFile(trace_flush_.get_policy());
+        trace_ = new VerilatedVcdC(trace_file_);
 #endif
         dut_->trace(trace_, 99);
         trace_->open(trace_file.c_str());
     }
 }
 
+template <class VTop>
+void Testbench<VTop>::flush_trace() {
+    if(is_trace_open()) {
+        trace_->flush();
+#ifndef TRACE_FST
+        trace_file_->flush();
+#endif
+    }
+}
+
 template <class VTop>
 void Testbench<VTop>::close_trace() {
     if (is_trace_open()) {
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "mmio_bus.h"
+
+/*
+    VDEV (Virtual Devices)
+    ======================
+    Set of 8 registers to interact with the simulator
+
+    -------+-----------+-------------------------------------------------
+    Offset | Name      | Description
+    -------+-----------+-------------------------------------------------
+    0x00   | CONSOLE   | Console register (console input/output)
+    0x04   | reserved  | --
+    0x08   | CYCLE     | CYCLE register low-word  (64-bit cycle counter)
+    0x0C   | CYCLE_HI  | CYCLE high-word
+    0x10   | INSTRET   | INSTRET low-word (64-bit instruction retired counter)
+    0x14   | INSTRET_HI| INSTRET high-word
+    0x18   | reserved  | --
+    0x1C   | SIMCTRL   | Simulation control register
+    -------+-----------+-------------------------------------------------
+
+    Register Description
+    =======================
+    0x00: CONSOLE
+        CONSOLE[7:0]:   Tx data
+        CONSOLE[15:8]:  Rx data
+        CONSOLE[16]:    Tx valid
+        CONSOLE[17]:    Rx valid
+
+    0x08: CYCLE
+        CYCLE[31:0]:    Low word of cycle counter
+
+    0x0C: CYCLE_HI
+        CYCLE_HI[31:0]: High word of cycle counter
+
+    0x10: INSTRET
+        INSTRET[31:0]:  Low word of instruction retired counter
+
+    0x14: INSTRET_HI
+        INSTRET_HI[31:0]: High word of instruction retired counter
+
+    0x1C: SIMCTRL
+        SIMCTRL[7:0]:   Return code
+        SIMCTRL[8]:     Finish request
+
+    A store with byte 0 enabled to CONSOLE prints Tx data. The counters read
+    the simulator's values at the cycle of the load and ignore stores. A store
+    setting SIMCTRL[8] requests the end of the simulation, the bit reads back
+    as 0. The other registers read back what was stored.
+*/
+class Vdev: public MmioDevice {
+public:
+    enum {
+        CONSOLE     = 0x00,
+        CYCLE       = 0x08,
+        CYCLE_HI    = 0x0C,
+        INSTRET     = 0x10,
+        INSTRET_HI  = 0x14,
+        SIMCTRL     = 0x1C,
+        SIZE        = 0x20
+    };
+
+    // Simulator side of the registers
+    class Host {
+    public:
+        virtual ~Host() {}
+
+        virtual uint64_t vdev_cycles() = 0;
+        virtual uint64_t vdev_instret() = 0;
+        virtual void vdev_putc(char c) = 0;
+        virtual void vdev_finish(uint8_t ret_code) = 0;
+    };
+
+    Vdev(Host *host): host(host) {}
+
+    uint32_t read(uint32_t offset) override {
+        switch(offset) {
+            case CYCLE:         return (uint32_t)host->vdev_cycles();
+            case CYCLE_HI:      return (uint32_t)(host->vdev_cycles() >> 32);
+            case INSTRET:       return (uint32_t)host->vdev_instret();
+            case INSTRET_HI:    return (uint32_t)(host->vdev_instret() >> 32);
+            default:            return regs[offset / 4];
+        }
+    }
+
+    void write(uint32_t offset, uint32_t data, uint8_t mask) override {
+        uint32_t &reg = regs[offset / 4];
+        for(int i = 0; i < 4; i++) {
+            if(mask & (1 << i)) {
+                reg = (reg & ~(0xffu << (i * 8))) | (data & (0xffu << (i * 8)));
+            }
+        }
+        if(offset == CONSOLE && (mask & 0x1)) {
+            host->vdev_putc(reg & 0xff);
+        }
+        if(offset == SIMCTRL && (reg & (1 << 8))) {
+            reg &= ~(1u << 8);
+            host->vdev_finish(reg & 0xff);
+        }
+    }
+
+    void reset() override { memset(regs, 0, sizeof(regs)); }
+
+    void *get_state() override { return regs; }
+    size_t get_state_size() override { return sizeof(regs); }
+
+private:
+    Host    *host;
+    uint32_t regs[SIZE / 4] = {};
+};
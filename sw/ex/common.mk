@@ -6,12 +6,14 @@ SRCS?=
 EXEC?= a.elf
 TRACE?= 
 LOG?=
+RAM_SIZE?= 65536
 
 ################################################################################
 CFLAGS += -Wall
 CFLAGS += -march=rv32i -mabi=ilp32 -nostartfiles -ffreestanding
 CFLAGS += -I$(ORION_HOME)/sw/lib/include
 LFLAGS += -T $(ORION_HOME)/sw/lib/link/link.ld -Wl,-Map=$(BUILD_DIR)/$(basename $(EXEC)).map
+LFLAGS += -Wl,--defsym=__ram_size=$(RAM_SIZE)
 LFLAGS += -L $(ORION_HOME)/sw/lib/build -ltinyc
 
 SRCS?=
@@ -27,7 +29,7 @@ ifeq ($(LOG), 1)
     ORIONSIM_FLAGS += --log $(ORION_HOME)/sim.log
 endif
 
-SPIKE_FLAGS := --isa=rv32i -m0x10000:0x10000
+SPIKE_FLAGS := --isa=rv32i -m0x10000:$(RAM_SIZE)
 
 default: build
 
@@ -41,8 +43,6 @@ $(BUILD_DIR)/$(EXEC): $(SRCS)
 	mkdir -p $(BUILD_DIR)
 	$(RISCV_TOOLCHAIN_PREFIX)gcc $(CFLAGS) $^ -o $@ $(LFLAGS)
 	$(RISCV_TOOLCHAIN_PREFIX)objdump -dt $@ > $(basename $@).lst
-	$(RISCV_TOOLCHAIN_PREFIX)objcopy -O binary $@ $(basename $@).bin
-	xxd -e -c 4 $(basename $@).bin | awk '{print $$2}' > $(basename $@).hex
 
 
 ################################################################################
@@ -51,7 +51,17 @@ $(BUILD_DIR)/$(EXEC): $(SRCS)
 .PHONY: run
 run: $(BUILD_DIR)/$(EXEC)
 	@echo "Running $(EXEC)"
-	orionsim $(ORIONSIM_FLAGS) $(basename $<).hex
+	orionsim $(ORIONSIM_FLAGS) $<
+
+
+################################################################################
+# run-cosim: Runs the program on Orionsim, checked in lockstep against the
+#            built-in reference model
+################################################################################
+.PHONY: run-cosim
+run-cosim: $(BUILD_DIR)/$(EXEC)
+	@echo "Running $(EXEC) with co-simulation"
+	orionsim $(ORIONSIM_FLAGS) --cosim $<
 
 
 ################################################################################
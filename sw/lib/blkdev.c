@@ -0,0 +1,35 @@
+#include <blkdev.h>
+#include <mmio.h>
+
+extern unsigned int __blkdev_base_addr;
+
+#define BLKDEV_ADDR             (uintptr_t)&__blkdev_base_addr   // Base address of block device registers
+#define BLKDEV_SECTOR_ADDR      (BLKDEV_ADDR + 0x00)    // First sector
+#define BLKDEV_BUF_ADDR         (BLKDEV_ADDR + 0x04)    // Guest buffer address
+#define BLKDEV_LEN_ADDR         (BLKDEV_ADDR + 0x08)    // Bytes to read
+#define BLKDEV_CMD_ADDR         (BLKDEV_ADDR + 0x0C)    // Command register
+#define BLKDEV_STATUS_ADDR      (BLKDEV_ADDR + 0x10)    // Status register
+#define BLKDEV_NSECTORS_ADDR    (BLKDEV_ADDR + 0x14)    // Size in sectors
+
+#define BLKDEV_CMD_READ         1
+
+#define BLKDEV_STATUS_BUSY      (1 << 0)
+#define BLKDEV_STATUS_DONE      (1 << 1)
+#define BLKDEV_STATUS_ERROR     (1 << 2)
+
+uint32_t blkdev_nsectors() {
+    return REG32(BLKDEV_NSECTORS_ADDR);
+}
+
+int blkdev_read(uint32_t sector, void *buf, uint32_t len) {
+    REG32(BLKDEV_SECTOR_ADDR) = sector;
+    REG32(BLKDEV_BUF_ADDR) = (uint32_t)(uintptr_t)buf;
+    REG32(BLKDEV_LEN_ADDR) = len;
+    REG32(BLKDEV_CMD_ADDR) = BLKDEV_CMD_READ;
+
+    uint32_t status;
+    do {
+        status = REG32(BLKDEV_STATUS_ADDR);
+    } while(status & BLKDEV_STATUS_BUSY);
+    return (status & BLKDEV_STATUS_ERROR) ? -1 : 0;
+}
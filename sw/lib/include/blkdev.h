@@ -0,0 +1,13 @@
+#pragma once
+#include <stdint.h>
+
+// Block device (orionsim --blk)
+
+#define BLKDEV_SECTOR_SIZE  512
+
+// Size of the device in sectors
+uint32_t blkdev_nsectors();
+
+// Read len bytes starting at a sector into buf, wait for completion.
+// Returns 0 on success, -1 on error
+int blkdev_read(uint32_t sector, void *buf, uint32_t len);
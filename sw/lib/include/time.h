@@ -3,4 +3,10 @@
 
 typedef uint64_t clock_t;
 
-clock_t cycles();
\ No newline at end of file
+clock_t cycles();
+
+// Machine timer (counts cycles from reset)
+clock_t mtime();
+
+// Sleep in WFI until the machine timer reaches t
+void sleep_until(clock_t t);
\ No newline at end of file
@@ -1,5 +1,10 @@
 #include "vdev.h"
 #include "time.h"
+#include <mmio.h>
+
+#define CLINT_ADDR              0x02000000              // Base address of the machine timer
+#define CLINT_MTIMECMP_ADDR     (CLINT_ADDR + 0x4000)   // Timer compare (64-bit)
+#define CLINT_MTIME_ADDR        (CLINT_ADDR + 0xBFF8)   // Timer (64-bit)
 
 
 clock_t cycles() {
@@ -10,4 +15,24 @@ clock_t cycles() {
         hi2 = vdev_cyclesh();
     } while (hi1 != hi2);
     return ((uint64_t)hi1 << 32) | lo;
+}
+
+clock_t mtime() {
+    uint32_t hi1, lo, hi2;
+    do {
+        hi1 = REG32(CLINT_MTIME_ADDR + 4);
+        lo  = REG32(CLINT_MTIME_ADDR);
+        hi2 = REG32(CLINT_MTIME_ADDR + 4);
+    } while (hi1 != hi2);
+    return ((uint64_t)hi1 << 32) | lo;
+}
+
+void sleep_until(clock_t t) {
+    // Raise the high word first, so that the compare never drops below t
+    REG32(CLINT_MTIMECMP_ADDR + 4) = 0xFFFFFFFF;
+    REG32(CLINT_MTIMECMP_ADDR)     = (uint32_t)t;
+    REG32(CLINT_MTIMECMP_ADDR + 4) = (uint32_t)(t >> 32);
+    while (mtime() < t) {
+        asm volatile ("wfi");
+    }
 }
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include <stdint.h>
+#include <blkdev.h>
+
+// Image generated by the Makefile: byte i is image_byte(i)
+#define IMAGE_BYTES     (4 * BLKDEV_SECTOR_SIZE + 100)
+#define IMAGE_SECTORS   5
+
+#define GUARD           0xa5
+
+static uint8_t buf[2 * BLKDEV_SECTOR_SIZE + 8];
+
+static uint8_t image_byte(uint32_t pos) {
+    return (pos * 7 + (pos >> 9)) & 0xff;
+}
+
+// Check len bytes of buf from off against the image from pos (zeros past its
+// end)
+static int check(uint32_t off, uint32_t pos, uint32_t len) {
+    for(uint32_t i = 0; i < len; i++) {
+        uint8_t exp = pos + i < IMAGE_BYTES ? image_byte(pos + i) : 0;
+        if(buf[off + i] != exp) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void fill(uint8_t v) {
+    for(uint32_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = v;
+    }
+}
+
+int main() {
+    // Size in sectors, the partial last sector included
+    if(blkdev_nsectors() != IMAGE_SECTORS) {
+        return 1;
+    }
+
+    // Two sectors into the middle of the buffer: the bytes around are not
+    // touched
+    fill(GUARD);
+    if(blkdev_read(1, buf + 4, 2 * BLKDEV_SECTOR_SIZE) != 0) {
+        return 2;
+    }
+    if(check(4, BLKDEV_SECTOR_SIZE, 2 * BLKDEV_SECTOR_SIZE) != 0) {
+        return 3;
+    }
+    for(int i = 0; i < 4; i++) {
+        if(buf[i] != GUARD || buf[4 + 2 * BLKDEV_SECTOR_SIZE + i] != GUARD) {
+            return 4;
+        }
+    }
+
+    // Last sector: the bytes past the end of the image read as zeros
+    fill(GUARD);
+    if(blkdev_read(IMAGE_SECTORS - 1, buf, BLKDEV_SECTOR_SIZE) != 0) {
+        return 5;
+    }
+    if(check(0, (IMAGE_SECTORS - 1) * BLKDEV_SECTOR_SIZE, BLKDEV_SECTOR_SIZE) != 0) {
+        return 6;
+    }
+
+    // A sector past the end is rejected
+    if(blkdev_read(IMAGE_SECTORS, buf, BLKDEV_SECTOR_SIZE) != -1) {
+        return 7;
+    }
+    return 0;
+}
@@ -6,12 +6,14 @@ SRCS?=
 EXEC?= a.elf
 TRACE?= 
 LOG?=
+RAM_SIZE?= 65536
 
 ################################################################################
 RVPREFIX := riscv64-unknown-elf
 CFLAGS += -Wall -O0
 CFLAGS += -march=rv32im -mabi=ilp32 -nostartfiles -ffreestanding -I ../include
 LFLAGS := -T $(ORION_HOME)/sw/lib/link/link.ld -Wl,-Map=$(BUILD_DIR)/$(basename $(EXEC)).map
+LFLAGS += -Wl,--defsym=__ram_size=$(RAM_SIZE)
 
 SRCS += $(ORION_HOME)/sw/lib/start.S
 
@@ -26,7 +28,7 @@ ifeq ($(LOG), 1)
     ORIONSIM_FLAGS += --log $(ORION_HOME)/sim.log
 endif
 
-SPIKE_FLAGS := --isa=rv32im -m0x10000:0x10000
+SPIKE_FLAGS := --isa=rv32im -m0x10000:$(RAM_SIZE)
 
 default: build
 
@@ -40,8 +42,6 @@ $(BUILD_DIR)/$(EXEC): $(SRCS)
 	mkdir -p $(BUILD_DIR)
 	$(RISCV_TOOLCHAIN_PREFIX)gcc $(CFLAGS) $^ -o $@ $(LFLAGS)
 	$(RISCV_TOOLCHAIN_PREFIX)objdump -dt $@ > $(basename $@).lst
-	$(RISCV_TOOLCHAIN_PREFIX)objcopy -O binary $@ $(basename $@).bin
-	xxd -e -c 4 $(basename $@).bin | awk '{print $$2}' > $(basename $@).hex
 
 
 ################################################################################
@@ -50,7 +50,17 @@ $(BUILD_DIR)/$(EXEC): $(SRCS)
 .PHONY: run
 run: $(BUILD_DIR)/$(EXEC)
 	@echo "Running $(EXEC)"
-	orionsim $(ORIONSIM_FLAGS) $(basename $<).hex
+	orionsim $(ORIONSIM_FLAGS) $<
+
+
+################################################################################
+# run-cosim: Runs the program on Orionsim, checked in lockstep against the
+#            built-in reference model
+################################################################################
+.PHONY: run-cosim
+run-cosim: $(BUILD_DIR)/$(EXEC)
+	@echo "Running $(EXEC) with co-simulation"
+	orionsim $(ORIONSIM_FLAGS) --cosim $<
 
 
 ################################################################################
@@ -72,6 +82,45 @@ run-verif: $(BUILD_DIR)/$(EXEC)
 # orionsim $(ORIONSIM_FLAGS) --log $(ORIONSIM_LOG) --log-format spike $(basename $<).hex || true
 	
 
+################################################################################
+# run-compare: Runs the program on Orionsim without and with each set of
+#              COMPARE_FLAGS (';' separated), and requires the same results
+#              (COMPARE_CHECK: retcode, cycles, instret, console, mem)
+################################################################################
+COMPARE_FLAGS?=
+COMPARE_CHECK?= retcode,cycles,instret,console,mem
+
+.PHONY: run-compare
+run-compare: $(BUILD_DIR)/$(EXEC)
+	@echo "Comparing $(EXEC) runs"
+	bash $(ORION_HOME)/scripts/compare_runs.sh --elf $< --build-dir $(BUILD_DIR) \
+		--orionsim-flags "$(ORIONSIM_FLAGS)" \
+		--compare-flags "$(COMPARE_FLAGS)" --check "$(COMPARE_CHECK)"
+
+
+################################################################################
+# test: Runs the check of the test (run_tests.sh): TEST_TARGET, spike
+#       verification unless the test sets it
+################################################################################
+TEST_TARGET?= run-verif
+
+.PHONY: test
+test: $(TEST_TARGET)
+
+
+################################################################################
+# batch-entry: Prints the orionsim batch manifest entry of the program
+################################################################################
+BATCH_MAX_CYCLES?= 1000000
+BATCH_RETCODE?= 0
+# Block device image (--blk) of the program, if it needs one
+BATCH_BLK?=
+
+.PHONY: batch-entry
+batch-entry: $(BUILD_DIR)/$(EXEC)
+	@echo "$(abspath $(BUILD_DIR))/$(EXEC) $(BATCH_MAX_CYCLES) $(BATCH_RETCODE)$(if $(strip $(BATCH_BLK)), blk=$(abspath $(BATCH_BLK)))"
+
+
 ################################################################################
 # clean: Cleans the build directory
 ################################################################################